@@ -17,6 +17,18 @@
 #include "random_int.h"
 #include "math.h"
 #include "render_engine.h"
+#include "frame_cache.h"
+#include "maze_world.h"
+#include "maze_session.h"
+#ifdef MAZE_STREAM_CHUNKS
+#include "maze_stream.h"
+#endif
+#ifdef MAZE_FRAME_ATLAS
+#include "frame_atlas.h"
+#endif
+#ifdef MAZE_COMPILED_LEVEL
+#include "maze_level.h"
+#endif
 #ifdef USE_MODULE_GAME_CONTROLLER
 #include "game_controller_host.h"
 #include "game_controller.h"
@@ -24,35 +36,118 @@
 
 #define SCREEN_WIDTH 80
 #define SCREEN_HEIGHT 24
-#define CAMERA_FOV_HORIZONTAL 100
-#define CAMERA_FOV_VERTICAL 75
-#define CAMERA_MOVE 0.5
-#define CAMERA_ROTATE 15
-#define NUM_TRIANGLES 120
+#if defined(RENDER_ENGINE_FIXED_WIDTH) && \
+        ((RENDER_ENGINE_FIXED_WIDTH != SCREEN_WIDTH) || \
+        (RENDER_ENGINE_FIXED_HEIGHT != SCREEN_HEIGHT))
+#warning "RENDER_ENGINE_FIXED_WIDTH/HEIGHT do not match the screen size"
+#endif
+#define RENDER_SLICE_MS 2 ///< longest a render task runs before yielding
+#define RENDER_SLICE_TRIANGLES 8 ///< triangles painted between time checks
 
-// World generation
-#define WALL_HEIGHT 3
-#define TILE_SIZE 4
-#define WORLD_BACKGROUND Blue
-#define WIN_TILE Green
-#define REG_TILE Red
-#define POS_X_WALL Yellow
-#define NEG_X_WALL White
-#define POS_Y_WALL Cyan
-#define NEG_Y_WALL Magenta
+// Frames kept by the frame cache, each one is SCREEN_WIDTH * SCREEN_HEIGHT
+// (1920) bytes of RAM. The frame shown is one of them, so the default of 1
+// costs the same as a plain framebuffer but reuses nothing. Poses one keypress
+// away are only pre-rendered into the frames beyond the one shown, it takes
+// MAZE_NUM_MOVES + 1 (7) frames to pre-render all of them.
+#ifndef MAZE_FRAME_CACHE_FRAMES
+#define MAZE_FRAME_CACHE_FRAMES 1
+#endif
+#if MAZE_FRAME_CACHE_FRAMES < 1
+#error "MAZE_FRAME_CACHE_FRAMES must hold at least the frame shown"
+#endif
+
+// Define MAZE_RANDOM_SIZE to play a new random maze of that many cells square
+// every game instead of the built in one
+#if defined(MAZE_RANDOM_SIZE) && defined(MAZE_COMPILED_LEVEL)
+#error "MAZE_RANDOM_SIZE and MAZE_COMPILED_LEVEL pick different mazes"
+#endif
+#ifdef MAZE_RANDOM_SIZE
+#if MAZE_RANDOM_SIZE < 5
+#error "MAZE_RANDOM_SIZE must be at least 5 to hold the built in maze"
+#endif
+#if MAZE_RANDOM_SIZE / 2 > MAZE_POSE_MAX_CELLS
+#error "MAZE_RANDOM_SIZE is too large, poses far from the exit would wrap around"
+#endif
+#ifdef MAZE_STREAM_CHUNKS
+#define MAZE_INSTANCES MAZE_NUM_INSTANCES ///< only the built in maze is loaded whole
+#else
+#define MAZE_INSTANCES MAZE_GRID_INSTANCES(MAZE_RANDOM_SIZE, MAZE_RANDOM_SIZE)
+#endif
+#define MAZE_TRIANGLES (2 * MAZE_GRID_INSTANCES(MAZE_RANDOM_SIZE, MAZE_RANDOM_SIZE))
+#elif defined(MAZE_COMPILED_LEVEL)
+// Define MAZE_COMPILED_LEVEL to play the maze_level.c written by
+// tools/maze_compile.c, which stays in flash
+#define MAZE_TRIANGLES MAZE_LEVEL_TRIANGLES
+#else
+#define MAZE_INSTANCES MAZE_NUM_INSTANCES
+#define MAZE_TRIANGLES MAZE_NUM_TRIANGLES
+#endif
+
+// Define MAZE_STREAM_CHUNKS to keep only that many chunks of the maze around
+// the player in the world, paged in from the grid as the player moves
+#ifdef MAZE_STREAM_CHUNKS
+#ifndef MAZE_STREAM_RADIUS
+#define MAZE_STREAM_RADIUS 1 ///< chunks kept on each side of the player's chunk
+#endif
+#if MAZE_STREAM_CHUNKS < (2 * MAZE_STREAM_RADIUS + 1) * (2 * MAZE_STREAM_RADIUS + 1)
+#error "MAZE_STREAM_CHUNKS cannot hold every chunk within MAZE_STREAM_RADIUS"
+#endif
+#define MAZE_RESIDENT_TRIANGLES (2 * MAZE_STREAM_INSTANCES(MAZE_STREAM_CHUNKS))
+#else
+#define MAZE_RESIDENT_TRIANGLES MAZE_TRIANGLES
+#endif
+
+// Frames rendered ahead of time by tools/maze_atlas.c -c
+#ifdef MAZE_FRAME_ATLAS
+extern const uint8_t maze_atlas[];
+extern const uint32_t maze_atlas_size;
+#endif
 
-/// game structure
+/// game structure, everything but the player is shared by any session
 struct maze_game_t {
-    camera_t camera; ///< camera where the player is
+    maze_session_t player; ///< pose, frame, keys and times of the player
     world_t world; ///< game world
-    framebuffer_t framebuffer; ///< screen framebuffer
-    uint16_t timer; ///< keep track of how long it takes to complete the maze
-    uint8_t bufAlloc[SCREEN_WIDTH * SCREEN_HEIGHT]; ///< don't use directly
-    triangle_t triangles[NUM_TRIANGLES]; ///< triangle data
+    frame_cache_t cache; ///< recently rendered frames
+    frame_cache_entry_t cacheEntries[MAZE_FRAME_CACHE_FRAMES];
+    uint8_t cacheAlloc[MAZE_FRAME_CACHE_FRAMES * SCREEN_WIDTH * SCREEN_HEIGHT]; ///< don't use directly
+#ifdef MAZE_RANDOM_SIZE
+    maze_grid_t grid; ///< layout of the random maze
+    uint8_t gridCells[MAZE_GRID_BYTES(MAZE_RANDOM_SIZE, MAZE_RANDOM_SIZE)];
+#endif
+#ifndef MAZE_COMPILED_LEVEL
+    render_instance_t instances[MAZE_INSTANCES]; ///< tiles of the world
+#endif
+#ifdef MAZE_STREAM_CHUNKS
+    maze_stream_t stream; ///< chunks of the maze in the world
+    maze_chunk_t streamChunks[MAZE_STREAM_CHUNKS];
+    render_instance_t streamPool[MAZE_STREAM_INSTANCES(MAZE_STREAM_CHUNKS)]; ///< don't use directly
+    uint32_t streamStall; ///< ms spent paging in chunks
+#endif
+    render_context_t render; ///< frame being rendered a slice at a time
+    render_order_t renderOrder[MAZE_RESIDENT_TRIANGLES]; ///< sort space for render
+    framebuffer_t renderFrame; ///< framebuffer being rendered into
+    frame_cache_key_t renderKey; ///< pose being rendered
+    uint8_t renderJob; ///< what to do with the frame being rendered
+    frame_cache_key_t speculated[MAZE_NUM_MOVES]; ///< poses one keypress away
+    uint8_t nextSpeculation; ///< next pose one keypress away to pre-render
+    uint8_t speculatedRendered; ///< bit mask of poses that were pre-rendered
+    uint32_t speculativeHits; ///< keypresses answered by a pre-rendered frame
+#ifdef MAZE_FRAME_ATLAS
+    frame_atlas_t atlas; ///< frames rendered ahead of time
+    uint8_t atlasValid; ///< atlas matches the screen and can be used
+    uint32_t atlasFrames; ///< frames taken from the atlas
+#endif
     uint8_t id; ///< ID of game
 };
 static struct maze_game_t game;
 
+/// reasons a frame is rendered
+enum render_job {
+    RenderNone,
+    RenderDisplay, ///< the player is waiting to see the frame
+    RenderSpeculate ///< the player may want to see the frame soon
+};
+
 // note the user doesn't need to access these functions directly so they are
 // defined here instead of in the .h file
 // further they are made static so that no other files can access them
@@ -63,12 +158,19 @@ static void Play(void);
 static void Help(void);
 static void GameOver();
 
-static uint16_t AddTile(uint16_t index, int x, int y, uint8_t posXWall,
-        uint8_t negXWall, uint8_t posYWall, uint8_t negYWall);
-static void IncrementTimer();
 static void RenderWorld();
-static void MoveCamera(float dx, float dy);
-static void CheckWin();
+#ifdef MAZE_STREAM_CHUNKS
+static void StreamWorld();
+#endif
+static void ShowFrame();
+static void StartRender(frame_cache_key_t *key, camera_t *camera, uint8_t job);
+static void CancelRender();
+static void RenderSlice();
+static uint8_t ReadAtlas(frame_cache_key_t *key, uint8_t *buffer);
+static void Speculate();
+static void StartSpeculation();
+static uint8_t WasSpeculated(frame_cache_key_t *key);
+static void ProcessInput();
 
 void MazeGame_Init(void) {
     // Register the module with the game system and give it the name "MAZE"
@@ -105,280 +207,260 @@ void Play(void) {
     Game_HideCursor();
     Game_ClearScreen();
     
-    // Create the world data
-    game.camera.fovHorizontal = CAMERA_FOV_HORIZONTAL;
-    game.camera.fovVertical = CAMERA_FOV_VERTICAL;
-    game.camera.location.x = 0;
-    game.camera.location.y = -2 * TILE_SIZE;
-    game.camera.location.z = 1.8;
-    game.camera.rotation.x = 0;
-    game.camera.rotation.y = 0;
-    game.camera.rotation.z = 90;
-    game.framebuffer.buffer = game.bufAlloc;
-    game.framebuffer.width = SCREEN_WIDTH;
-    game.framebuffer.height = SCREEN_HEIGHT;
-    game.world.backgroundColor = WORLD_BACKGROUND;
-    game.world.numTriangles = NUM_TRIANGLES;
-    game.world.triangles = game.triangles;
-    
     // Create the world
-    volatile int i = 0;
-    i += AddTile(i, 0, 0, 0, 1, 1, 1);
-    
-    i += AddTile(i, 1, 0, 1, 0, 0, 0);
-    i += AddTile(i, 1, -1, 1, 0, 0, 1);
-    i += AddTile(i, 0, -1, 0, 0, 0, 1);
-    i += AddTile(i, -1, -1, 0, 1, 0, 1);
-    i += AddTile(i, -1, 0, 0, 1, 0, 0);
-    i += AddTile(i, -1, 1, 0, 1, 1, 0);
-    i += AddTile(i, 0, 1, 0, 0, 0, 0);
-    i += AddTile(i, 1, 1, 1, 0, 1, 0);
-    
-    i += AddTile(i, 0, 2, 0, 1, 1, 0);
-    i += AddTile(i, 1, 2, 0, 0, 1, 0);
-    i += AddTile(i, 2, 2, 1, 0, 1, 0);
-    i += AddTile(i, 2, 1, 1, 0, 0, 0);
-    i += AddTile(i, 2, 0, 1, 0, 0, 0);
-    i += AddTile(i, 2, -1, 1, 0, 0, 0);
-    i += AddTile(i, 2, -2, 1, 0, 0, 1);
-    i += AddTile(i, 1, -2, 0, 0, 0, 1);
-    i += AddTile(i, 0, -2, 0, 0, 0, 1);
-    i += AddTile(i, -1, -2, 0, 0, 0, 1);
-    i += AddTile(i, -2, -2, 0, 1, 0, 1);
-    i += AddTile(i, -2, -1, 0, 1, 0, 0);
-    i += AddTile(i, -2, 0, 0, 1, 0, 0);
-    i += AddTile(i, -2, 1, 0, 1, 0, 0);
-    i += AddTile(i, -2, 2, 0, 1, 1, 0);
-    i += AddTile(i, -1, 2, 0, 0, 1, 0);
+#ifdef MAZE_COMPILED_LEVEL
+    MazeWorld_LoadLevel(&game.world, &maze_level);
+#else
+    MazeWorld_Build(&game.world, game.instances);
+#endif
+#ifdef MAZE_RANDOM_SIZE
+    MazeGrid_Init(&game.grid, game.gridCells, MAZE_RANDOM_SIZE, MAZE_RANDOM_SIZE,
+            MAZE_RANDOM_SIZE / 2, MAZE_RANDOM_SIZE / 2);
+    MazeGrid_Generate(&game.grid, ((uint32_t) random_int(0, INT16_MAX) << 16) |
+            (uint32_t) random_int(0, INT16_MAX));
+#ifdef MAZE_STREAM_CHUNKS
+    MazeStream_Init(&game.stream, &game.world, &game.grid, game.streamChunks,
+            game.streamPool, MAZE_STREAM_CHUNKS, MAZE_STREAM_RADIUS);
+#else
+    MazeWorld_Load(&game.world, &game.grid, game.instances);
+#endif
+#elif defined(MAZE_STREAM_CHUNKS)
+    MazeStream_Init(&game.stream, &game.world, MazeWorld_Grid(), game.streamChunks,
+            game.streamPool, MAZE_STREAM_CHUNKS, MAZE_STREAM_RADIUS);
+#endif
     
-//    i += AddTile(i, 0, 3, 0, 0, 1, 0);
-//    i += AddTile(i, 1, 3, 0, 0, 1, 0);
-//    i += AddTile(i, 2, 3, 0, 0, 1, 0);
-//    i += AddTile(i, 3, 3, 1, 0, 1, 0);
-//    i += AddTile(i, 3, 2, 1, 0, 0, 0);
-//    i += AddTile(i, 3, 1, 1, 0, 0, 0);
-//    i += AddTile(i, 3, 0, 1, 0, 0, 0);
-//    i += AddTile(i, 3, -1, 1, 0, 0, 0);
-//    i += AddTile(i, 3, -2, 1, 0, 0, 0);
-//    i += AddTile(i, 3, -3, 1, 0, 0, 1);
-//    i += AddTile(i, 2, -3, 0, 0, 0, 1);
-//    i += AddTile(i, 1, -3, 0, 0, 0, 1);
-//    i += AddTile(i, 0, -3, 0, 0, 0, 1);
-//    i += AddTile(i, -1, -3, 0, 0, 0, 1);
-//    i += AddTile(i, -2, -3, 0, 0, 0, 1);
-//    i += AddTile(i, -3, -3, 0, 1, 0, 1);
-//    i += AddTile(i, -3, -2, 0, 1, 1, 0);
-//    i += AddTile(i, -3, -1, 0, 1, 0, 0);
-//    i += AddTile(i, -3, 0, 0, 1, 0, 0);
-//    i += AddTile(i, -3, 1, 0, 1, 0, 0);
-//    i += AddTile(i, -3, 2, 0, 1, 0, 0);
-//    i += AddTile(i, -3, 3, 0, 1, 1, 0);
-//    i += AddTile(i, -2, 3, 0, 0, 1, 0);
-//    i += AddTile(i, -1, 3, 0, 0, 1, 0);
+    // Create the world data, the frame of the player is taken from the cache
+    MazeSession_Start(&game.player, 0, SCREEN_WIDTH, SCREEN_HEIGHT, TimeNow());
+    game.renderFrame.width = SCREEN_WIDTH;
+    game.renderFrame.height = SCREEN_HEIGHT;
+    game.renderFrame.layout = RenderLayoutRows;
+    game.renderJob = RenderNone;
+    FrameCache_Init(&game.cache, game.cacheEntries, game.cacheAlloc,
+            MAZE_FRAME_CACHE_FRAMES, SCREEN_WIDTH * SCREEN_HEIGHT);
+#ifdef MAZE_FRAME_ATLAS
+#if defined(MAZE_RANDOM_SIZE) || defined(MAZE_COMPILED_LEVEL)
+    // The atlas only holds frames of the built in maze
+    game.atlasValid = 0;
+#else
+    game.atlasValid = FrameAtlas_Open(&game.atlas, maze_atlas, maze_atlas_size) &&
+            (game.atlas.header->width == SCREEN_WIDTH) &&
+            (game.atlas.header->height == SCREEN_HEIGHT);
+#endif
+    game.atlasFrames = 0;
+#endif
     
     // initialize game variables
-    game.timer = 0;
+    game.speculativeHits = 0;
+#ifdef MAZE_STREAM_CHUNKS
+    game.streamStall = 0;
+#endif
     
     // Render the world
     RenderWorld();
     
-    // Add a receiver for player commands
+    // Add a receiver for player commands, keys are handled by the game loop
     Game_RegisterPlayer1Receiver(Receiver);
-    
-    // Keep track of how long it takes to complete the maze
-    Task_Schedule(IncrementTimer, 0, 100, 100);
+    Task_Schedule(ProcessInput, 0, 1, 1);
 }
 
-uint16_t AddTile(uint16_t index, int x, int y, uint8_t posXWall,
-        uint8_t negXWall, uint8_t posYWall, uint8_t negYWall) {
-    float offsetX = x * TILE_SIZE;
-    float offsetY = y * TILE_SIZE;
-    
-    // Paint the base
-    uint16_t addedTriangles = 2;
-    vector_t b0_0 = {offsetX - (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-    vector_t b0_1 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-    vector_t b0_2 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-    game.world.triangles[index].p1 = b0_0;
-    game.world.triangles[index].p2 = b0_1;
-    game.world.triangles[index].p3 = b0_2;
+void RenderWorld() {
+    frame_cache_key_t key = {game.player.pose.x, game.player.pose.y,
+            game.player.pose.yaw};
     
-    vector_t b1_0 = {offsetX + (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-    vector_t b1_1 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-    vector_t b1_2 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-    game.world.triangles[index + 1].p1 = b1_0;
-    game.world.triangles[index + 1].p2 = b1_1;
-    game.world.triangles[index + 1].p3 = b1_2;
+#ifdef MAZE_STREAM_CHUNKS
+    StreamWorld();
+#endif
     
-    if ((x == 0) && (y == 0)) {
-        game.world.triangles[index].color = WIN_TILE;
-        game.world.triangles[index + 1].color = WIN_TILE;
-    } else {
-        game.world.triangles[index].color = REG_TILE;
-        game.world.triangles[index + 1].color = REG_TILE;
+    // The poses being pre-rendered are around the old pose, unless the one
+    // being rendered right now is the one that is needed
+    Task_Remove(Speculate, 0);
+    if ((game.renderJob == RenderSpeculate) && (game.renderKey.x == key.x) &&
+            (game.renderKey.y == key.y) && (game.renderKey.yaw == key.yaw)) {
+        FrameCache_Lookup(&game.cache, &key);
+        game.speculativeHits++;
+        game.renderJob = RenderDisplay;
+        return;
     }
+    CancelRender();
     
-    // Positive X wall
-    if (posXWall) {
-        vector_t px0_0 = {offsetX + (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-        vector_t px0_1 = {offsetX + (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t px0_2 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles].p1 = px0_0;
-        game.world.triangles[index + addedTriangles].p2 = px0_1;
-        game.world.triangles[index + addedTriangles].p3 = px0_2;
-        game.world.triangles[index + addedTriangles].color = POS_X_WALL;
-        
-        vector_t px1_0 = {offsetX + (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t px1_1 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t px1_2 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles + 1].p1 = px1_0;
-        game.world.triangles[index + addedTriangles + 1].p2 = px1_1;
-        game.world.triangles[index + addedTriangles + 1].p3 = px1_2;
-        game.world.triangles[index + addedTriangles + 1].color = POS_X_WALL;
-                
-        addedTriangles += 2;
+    // Only render poses that have not been seen recently and are not in the
+    // atlas
+    game.player.frame.buffer = FrameCache_Lookup(&game.cache, &key);
+    if (game.player.frame.buffer == 0) {
+        game.player.frame.buffer = FrameCache_Insert(&game.cache, &key);
+        if (!ReadAtlas(&key, game.player.frame.buffer)) {
+            // The frame is shown once its last slice is rendered
+            StartRender(&key, &game.player.camera, RenderDisplay);
+            return;
+        }
+    } else if (WasSpeculated(&key)) {
+        game.speculativeHits++;
     }
     
-    // Negative X wall
-    if (negXWall) {
-        vector_t nx0_0 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-        vector_t nx0_1 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t nx0_2 = {offsetX - (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles].p1 = nx0_0;
-        game.world.triangles[index + addedTriangles].p2 = nx0_1;
-        game.world.triangles[index + addedTriangles].p3 = nx0_2;
-        game.world.triangles[index + addedTriangles].color = NEG_X_WALL;
-        
-        vector_t nx1_0 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t nx1_1 = {offsetX - (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t nx1_2 = {offsetX - (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles + 1].p1 = nx1_0;
-        game.world.triangles[index + addedTriangles + 1].p2 = nx1_1;
-        game.world.triangles[index + addedTriangles + 1].p3 = nx1_2;
-        game.world.triangles[index + addedTriangles + 1].color = NEG_X_WALL;
-        
-        addedTriangles += 2;
+    ShowFrame();
+}
+
+#ifdef MAZE_STREAM_CHUNKS
+void StreamWorld() {
+    tint_t start;
+    
+    if (MazeStream_Resident(&game.stream, &game.player.camera.location)) {
+        return;
     }
     
-    // Positive Y wall
-    if (posYWall) {
-        vector_t py0_0 = {offsetX + (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-        vector_t py0_1 = {offsetX + (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t py0_2 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles].p1 = py0_0;
-        game.world.triangles[index + addedTriangles].p2 = py0_1;
-        game.world.triangles[index + addedTriangles].p3 = py0_2;
-        game.world.triangles[index + addedTriangles].color = POS_Y_WALL;
-        
-        vector_t py1_0 = {offsetX + (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t py1_1 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t py1_2 = {offsetX - (TILE_SIZE / 2), offsetY + (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles + 1].p1 = py1_0;
-        game.world.triangles[index + addedTriangles + 1].p2 = py1_1;
-        game.world.triangles[index + addedTriangles + 1].p3 = py1_2;
-        game.world.triangles[index + addedTriangles + 1].color = POS_Y_WALL;
-        
-        addedTriangles += 2;
+    // Paging in changes the world under the frame being rendered and under
+    // every cached frame
+    Task_Remove(Speculate, 0);
+    CancelRender();
+    start = TimeNow();
+    MazeStream_Update(&game.stream, &game.player.camera.location);
+    game.streamStall += TimeNow() - start;
+    FrameCache_Clear(&game.cache);
+}
+#endif
+
+void ShowFrame() {
+    // Measure the time from the key arriving to the frame starting to go out
+    MazeSession_Shown(&game.player, TimeNow());
+    Render_Engine_DisplayFrame(SUBSYSTEM_UART, &game.player.frame);
+    
+    // Use the time until the next key to pre-render where it could lead
+    StartSpeculation();
+}
+
+void StartRender(frame_cache_key_t *key, camera_t *camera, uint8_t job) {
+    game.renderKey = *key;
+    game.renderJob = job;
+    game.renderFrame.buffer = FrameCache_Insert(&game.cache, key);
+    Render_Engine_BeginFrame(&game.render, &game.world, camera,
+            &game.renderFrame, game.renderOrder);
+    Task_Schedule(RenderSlice, 0, 0, 0);
+}
+
+void CancelRender() {
+    if (game.renderJob != RenderNone) {
+        // Half a frame must not be found in the cache later
+        Task_Remove(RenderSlice, 0);
+        FrameCache_Remove(&game.cache, &game.renderKey);
+        game.renderJob = RenderNone;
     }
+}
+
+void RenderSlice() {
+    tint_t start = TimeNow();
     
-    // Negative Y wall
-    if (negYWall) {
-        vector_t ny0_0 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-        vector_t ny0_1 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t ny0_2 = {offsetX - (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles].p1 = ny0_0;
-        game.world.triangles[index + addedTriangles].p2 = ny0_1;
-        game.world.triangles[index + addedTriangles].p3 = ny0_2;
-        game.world.triangles[index + addedTriangles].color = NEG_Y_WALL;
-        
-        vector_t ny1_0 = {offsetX + (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t ny1_1 = {offsetX - (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), WALL_HEIGHT};
-        vector_t ny1_2 = {offsetX - (TILE_SIZE / 2), offsetY - (TILE_SIZE / 2), 0};
-        game.world.triangles[index + addedTriangles + 1].p1 = ny1_0;
-        game.world.triangles[index + addedTriangles + 1].p2 = ny1_1;
-        game.world.triangles[index + addedTriangles + 1].p3 = ny1_2;
-        game.world.triangles[index + addedTriangles + 1].color = NEG_Y_WALL;
-        
-        addedTriangles += 2;
+    // Give the other tasks a turn once the time for this slice is used up
+    while (!Render_Engine_StepFrame(&game.render, RENDER_SLICE_TRIANGLES)) {
+        if ((TimeNow() - start) >= RENDER_SLICE_MS) {
+            Task_Schedule(RenderSlice, 0, 0, 0);
+            return;
+        }
     }
     
-    return addedTriangles;
+    if (game.renderJob == RenderDisplay) {
+        game.renderJob = RenderNone;
+        game.player.frame.buffer = game.renderFrame.buffer;
+        ShowFrame();
+    } else {
+        game.renderJob = RenderNone;
+        Speculate();
+    }
 }
 
-void IncrementTimer() {
-    game.timer += 1;
+void StartSpeculation() {
+    maze_pose_t pose;
+    uint8_t move;
+    
+    for (move = 0; move < MAZE_NUM_MOVES; move++) {
+        pose = game.player.pose;
+        MazeWorld_ApplyMove(&pose, move);
+        game.speculated[move].x = pose.x;
+        game.speculated[move].y = pose.y;
+        game.speculated[move].yaw = pose.yaw;
+    }
+    game.nextSpeculation = 0;
+    game.speculatedRendered = 0;
+    Task_Schedule(Speculate, 0, 0, 0);
 }
 
-void RenderWorld() {
-    Render_Engine_RenderFrame(&game.world, &game.camera, &game.framebuffer);
-    Render_Engine_DisplayFrame(SUBSYSTEM_UART, &game.framebuffer);
+void Speculate() {
+    maze_pose_t pose;
+    camera_t camera;
+    frame_cache_key_t *key;
+    
+    // Render one pose at a time, in slices so a key arriving is not held up.
+    // Only the frames beyond the one shown are used, so it is never evicted
+    while ((game.nextSpeculation < MAZE_NUM_MOVES) &&
+            (game.nextSpeculation + 1 < MAZE_FRAME_CACHE_FRAMES)) {
+        key = &game.speculated[game.nextSpeculation++];
+        if (FrameCache_Contains(&game.cache, key)) {
+            continue;
+        }
+        
+        game.speculatedRendered |= 1 << (game.nextSpeculation - 1);
+        if (ReadAtlas(key, FrameCache_Insert(&game.cache, key))) {
+            continue;
+        }
+        pose.x = key->x;
+        pose.y = key->y;
+        pose.yaw = key->yaw;
+        MazeWorld_SetCamera(&pose, &camera);
+        StartRender(key, &camera, RenderSpeculate);
+        break;
+    }
 }
 
-void MoveCamera(float dx, float dy) {
-    float c = cos(game.camera.rotation.z * (3.14159 / 180.0));
-    float s = sin(game.camera.rotation.z * (3.14159 / 180.0));
+uint8_t WasSpeculated(frame_cache_key_t *key) {
+    uint8_t move;
     
-    game.camera.location.x += dx * c;
-    game.camera.location.y += dx * s;
+    for (move = 0; move < MAZE_NUM_MOVES; move++) {
+        if ((game.speculatedRendered & (1 << move)) &&
+                (game.speculated[move].x == key->x) &&
+                (game.speculated[move].y == key->y) &&
+                (game.speculated[move].yaw == key->yaw)) {
+            return 1;
+        }
+    }
     
-    game.camera.location.x += dy * -s;
-    game.camera.location.y += dy * c;
+    return 0;
 }
 
-void CheckWin() {
-    if ((game.camera.location.x > -2) && (game.camera.location.x < 2) &&
-            (game.camera.location.y > -2) && (game.camera.location.y < 2)) {
-        GameOver();
+uint8_t ReadAtlas(frame_cache_key_t *key, uint8_t *buffer) {
+#ifdef MAZE_FRAME_ATLAS
+    if (game.atlasValid && FrameAtlas_Read(&game.atlas, key, buffer)) {
+        game.atlasFrames++;
+        return 1;
     }
+#else
+    (void) key;
+    (void) buffer;
+#endif
+    return 0;
 }
 
 void Receiver(uint8_t c) {
-    switch (c) {
-        case 'w':
-        case 'W':
-            MoveCamera(CAMERA_MOVE, 0);
-            RenderWorld();
-            CheckWin();
-            break;
-        case 's':
-        case 'S':
-            MoveCamera(-CAMERA_MOVE, 0);
-            RenderWorld();
-            CheckWin();
-            break;
-        case 'a':
-        case 'A':
-            MoveCamera(0, CAMERA_MOVE);
-            RenderWorld();
-            CheckWin();
-            break;
-        case 'd':
-        case 'D':
-            MoveCamera(0, -CAMERA_MOVE);
-            RenderWorld();
-            CheckWin();
-            break;
-        case '<':
-        case ',':
-            game.camera.rotation.z += CAMERA_ROTATE;
-            RenderWorld();
-            break;
-        case '>':
-        case '.':
-            game.camera.rotation.z -= CAMERA_ROTATE;
-            RenderWorld();
-            break;
-        case '\r':
-            //GameOver();
-            break;
-        default:
-            break;
+    // Only queue the key, this may be called from an interrupt and must not
+    // wait for a frame to be rendered or sent
+    MazeSession_Key(&game.player, c, TimeNow());
+}
+
+void ProcessInput() {
+    // Apply every waiting key, then render only the pose they lead to
+    if (!MazeSession_ApplyKeys(&game.player, TimeNow())) {
+        return;
     }
+    if (game.player.state == MazeSessionWon) {
+        GameOver();
+        return;
+    }
+    RenderWorld();
 }
 
 void GameOver() {
     // clean up all scheduled tasks
-    Task_Remove(IncrementTimer, 0);
+    Task_Remove(ProcessInput, 0);
+    Task_Remove(Speculate, 0);
+    CancelRender();
     // if a controller was used then remove the callbacks
 #ifdef USE_MODULE_GAME_CONTROLLER
     // Not supported
@@ -386,7 +468,30 @@ void GameOver() {
     Terminal_SetColor(SUBSYSTEM_UART, Black);
     Terminal_CursorXY(SUBSYSTEM_UART, 0, 0);
     // show score
-    Game_Printf("Game Over! Final time: %d.%d seconds\r\n", game.timer / 10, game.timer % 10);
+    Game_Printf("Game Over! Final time: %lu.%lu seconds\r\n",
+            (unsigned long) (game.player.time / 1000),
+            (unsigned long) ((game.player.time / 100) % 10));
+    // show how well the frame cache did
+    uint32_t lookups = game.cache.hits + game.cache.misses;
+    Game_Printf("Frame cache: %lu of %lu frames reused (%lu%%), %lu bytes\r\n",
+            (unsigned long) game.cache.hits, (unsigned long) lookups,
+            (unsigned long) (lookups ? (100 * game.cache.hits) / lookups : 0),
+            (unsigned long) FrameCache_MemoryUsed(&game.cache));
+    Game_Printf("Pre-rendered: %lu frames used, key to frame: %lu ms average, "
+            "%lu ms worst\r\n", (unsigned long) game.speculativeHits,
+            (unsigned long) (game.player.latencyCount ?
+            game.player.latencyTotal / game.player.latencyCount : 0),
+            (unsigned long) game.player.latencyMax);
+#ifdef MAZE_FRAME_ATLAS
+    Game_Printf("Frame atlas: %lu frames\r\n", (unsigned long) game.atlasFrames);
+#endif
+#ifdef MAZE_STREAM_CHUNKS
+    Game_Printf("Streaming: %u chunks resident (%u most), %lu bytes, %lu chunks "
+            "paged in, %lu ms stalled\r\n", game.stream.numChunks,
+            game.stream.peakChunks,
+            (unsigned long) MazeStream_MemoryUsed(&game.stream),
+            (unsigned long) game.stream.loads, (unsigned long) game.streamStall);
+#endif
     // unregister the receiver used to run the game
     Game_UnregisterPlayer1Receiver(Receiver);
     // show cursor (it was hidden at the beginning)
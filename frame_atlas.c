@@ -0,0 +1,130 @@
+#include "frame_atlas.h"
+#include <string.h>
+#ifdef FRAME_ATLAS_HOST
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+uint8_t FrameAtlas_Open(frame_atlas_t *atlas, const uint8_t *data, uint32_t size) {
+    const frame_atlas_header_t *header = (const frame_atlas_header_t *) data;
+    
+    // Make sure the block is an atlas this code understands
+    if ((size < sizeof(frame_atlas_header_t)) ||
+            (memcmp(header->magic, "MZAT", 4) != 0) ||
+            (header->version != FRAME_ATLAS_VERSION)) {
+        return 0;
+    }
+    if (size < sizeof(frame_atlas_header_t) +
+            ((uint64_t) header->numFrames * sizeof(frame_atlas_index_t))) {
+        return 0;
+    }
+    
+    atlas->data = data;
+    atlas->size = size;
+    atlas->header = header;
+    atlas->index = (const frame_atlas_index_t *) (data + sizeof(frame_atlas_header_t));
+    return 1;
+}
+
+uint8_t FrameAtlas_Read(frame_atlas_t *atlas, frame_cache_key_t *key, uint8_t *buffer) {
+    uint32_t length = (uint32_t) atlas->header->width * atlas->header->height;
+    uint32_t low = 0;
+    uint32_t high = atlas->header->numFrames;
+    uint32_t middle;
+    int result;
+    
+    // Binary search the sorted index for the pose
+    while (low < high) {
+        middle = low + ((high - low) / 2);
+        result = FrameAtlas_CompareKeys(&atlas->index[middle].key, key);
+        if (result == 0) {
+            break;
+        } else if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if ((low >= high) || (atlas->index[middle].offset >= atlas->size)) {
+        return 0;
+    }
+    
+    // Expand the runs into the framebuffer
+    const uint8_t *run = atlas->data + atlas->index[middle].offset;
+    const uint8_t *end = atlas->data + atlas->size;
+    uint32_t i = 0;
+    while ((i < length) && (run + 1 < end)) {
+        if (run[0] > length - i) {
+            return 0;
+        }
+        memset(buffer + i, run[1], run[0]);
+        i += run[0];
+        run += 2;
+    }
+    
+    return i == length;
+}
+
+uint32_t FrameAtlas_Encode(const uint8_t *buffer, uint32_t length, uint8_t *out) {
+    uint32_t size = 0;
+    uint32_t i = 0;
+    uint8_t count;
+    
+    while (i < length) {
+        // Count how many pixels in a row have the same color
+        count = 1;
+        while ((i + count < length) && (count < 255) &&
+                (buffer[i + count] == buffer[i])) {
+            count++;
+        }
+        out[size++] = count;
+        out[size++] = buffer[i];
+        i += count;
+    }
+    
+    return size;
+}
+
+int FrameAtlas_CompareKeys(const frame_cache_key_t *a, const frame_cache_key_t *b) {
+    if (a->yaw != b->yaw) {
+        return (a->yaw < b->yaw) ? -1 : 1;
+    }
+    if (a->y != b->y) {
+        return (a->y < b->y) ? -1 : 1;
+    }
+    if (a->x != b->x) {
+        return (a->x < b->x) ? -1 : 1;
+    }
+    return 0;
+}
+
+#ifdef FRAME_ATLAS_HOST
+uint8_t FrameAtlas_MapFile(frame_atlas_t *atlas, const char *path) {
+    struct stat info;
+    void *data;
+    int file = open(path, O_RDONLY);
+    
+    if (file < 0) {
+        return 0;
+    }
+    if ((fstat(file, &info) != 0) || (info.st_size == 0)) {
+        close(file);
+        return 0;
+    }
+    
+    // The mapping stays valid after the file is closed
+    data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    
+    if (!FrameAtlas_Open(atlas, data, info.st_size)) {
+        munmap(data, info.st_size);
+        return 0;
+    }
+    return 1;
+}
+#endif
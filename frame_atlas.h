@@ -0,0 +1,105 @@
+/**
+ * @defgroup frame_atlas Frame Atlas
+ * @file frame_atlas.h
+ * @version 1
+ * 
+ * Created on October 16, 2026
+ * 
+ * Read only collection of frames rendered ahead of time, one for every camera
+ * pose a tool decided to store. Looking a frame up in the atlas replaces
+ * Render_Engine_RenderFrame() with a binary search and a run length decode, so
+ * the time to produce a frame no longer depends on the world.
+ * 
+ * An atlas is one block of memory laid out as:
+ * - frame_atlas_header_t
+ * - numFrames frame_atlas_index_t entries sorted by pose (yaw, y, x)
+ * - the frames, each a list of (run length, color) byte pairs covering the
+ *   framebuffer row by row
+ * 
+ * All values are stored little endian. The block can be linked into flash as
+ * a const array (4 byte aligned) or, when FRAME_ATLAS_HOST is defined, mapped
+ * from a file with FrameAtlas_MapFile().
+ * 
+ * @{
+ */
+
+#ifndef FRAME_ATLAS_H
+#define FRAME_ATLAS_H
+
+#include <stdint.h>
+#include "frame_cache.h"
+
+#define FRAME_ATLAS_VERSION 1
+
+typedef struct frame_atlas_header {
+    uint8_t magic[4]; ///< "MZAT"
+    uint16_t version;
+    uint16_t width;
+    uint16_t height;
+    uint16_t reserved;
+    uint32_t numFrames;
+} frame_atlas_header_t;
+
+typedef struct frame_atlas_index {
+    frame_cache_key_t key;
+    uint16_t reserved;
+    uint32_t offset; ///< offset of the frame from the start of the atlas
+} frame_atlas_index_t;
+
+typedef struct frame_atlas {
+    const uint8_t *data;
+    uint32_t size;
+    const frame_atlas_header_t *header;
+    const frame_atlas_index_t *index;
+} frame_atlas_t;
+
+/** @brief Open an atlas
+ * 
+ * Checks the header of a block of atlas data and gets it ready for reading.
+ * 
+ * @param atlas Atlas to set up.
+ * @param data Atlas data, must stay valid while the atlas is used.
+ * @param size Size of the atlas data in bytes.
+ * @return 1 if the data holds a valid atlas, 0 otherwise.
+ */
+uint8_t FrameAtlas_Open(frame_atlas_t *atlas, const uint8_t *data, uint32_t size);
+
+/** @brief Read a frame out of an atlas
+ * 
+ * @param atlas Atlas to read from.
+ * @param key Pose of the camera.
+ * @param buffer Framebuffer data of width * height bytes to fill.
+ * @return 1 if the pose was found and the buffer filled, 0 otherwise.
+ */
+uint8_t FrameAtlas_Read(frame_atlas_t *atlas, frame_cache_key_t *key, uint8_t *buffer);
+
+/** @brief Compress a frame
+ * 
+ * Run length encodes framebuffer data the way it is stored in an atlas. Used
+ * by the tools that build atlases.
+ * 
+ * @param buffer Framebuffer data to compress.
+ * @param length Number of pixels in the framebuffer.
+ * @param out Output of at most 2 * length bytes.
+ * @return Number of bytes written to out.
+ */
+uint32_t FrameAtlas_Encode(const uint8_t *buffer, uint32_t length, uint8_t *out);
+
+/** @brief Order two poses the way the atlas index is sorted
+ * 
+ * @return Less than, equal to or greater than 0 like strcmp().
+ */
+int FrameAtlas_CompareKeys(const frame_cache_key_t *a, const frame_cache_key_t *b);
+
+#ifdef FRAME_ATLAS_HOST
+/** @brief Map an atlas file into memory and open it
+ * 
+ * @param atlas Atlas to set up.
+ * @param path Path of the atlas file.
+ * @return 1 if the file was mapped and holds a valid atlas, 0 otherwise.
+ */
+uint8_t FrameAtlas_MapFile(frame_atlas_t *atlas, const char *path);
+#endif
+
+/** @} */
+#endif // FRAME_ATLAS_H
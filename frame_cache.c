@@ -0,0 +1,98 @@
+#include "frame_cache.h"
+#include <stddef.h>
+
+// Cache helper functions
+static frame_cache_entry_t *findEntry(frame_cache_t *cache, frame_cache_key_t *key);
+static uint8_t keysEqual(frame_cache_key_t *a, frame_cache_key_t *b);
+
+void FrameCache_Init(frame_cache_t *cache, frame_cache_entry_t *entries,
+        uint8_t *storage, uint16_t numEntries, uint32_t frameSize) {
+    uint16_t i;
+    
+    cache->entries = entries;
+    cache->numEntries = numEntries;
+    cache->frameSize = frameSize;
+    for (i = 0; i < numEntries; i++) {
+        entries[i].buffer = storage + ((size_t) i * frameSize);
+    }
+    cache->hits = 0;
+    cache->misses = 0;
+    FrameCache_Clear(cache);
+}
+
+void FrameCache_Clear(frame_cache_t *cache) {
+    uint16_t i;
+    
+    for (i = 0; i < cache->numEntries; i++) {
+        cache->entries[i].lastUsed = 0;
+    }
+    cache->useCounter = 0;
+}
+
+uint8_t *FrameCache_Lookup(frame_cache_t *cache, frame_cache_key_t *key) {
+    frame_cache_entry_t *entry = findEntry(cache, key);
+    
+    if (entry == 0) {
+        cache->misses++;
+        return 0;
+    }
+    
+    cache->hits++;
+    entry->lastUsed = ++cache->useCounter;
+    return entry->buffer;
+}
+
+uint8_t FrameCache_Contains(frame_cache_t *cache, frame_cache_key_t *key) {
+    return findEntry(cache, key) != 0;
+}
+
+uint8_t *FrameCache_Insert(frame_cache_t *cache, frame_cache_key_t *key) {
+    frame_cache_entry_t *entry = findEntry(cache, key);
+    uint16_t i;
+    
+    // Pick the least recently used entry, empty entries are used first
+    if (entry == 0) {
+        entry = &cache->entries[0];
+        for (i = 1; i < cache->numEntries; i++) {
+            if (cache->entries[i].lastUsed < entry->lastUsed) {
+                entry = &cache->entries[i];
+            }
+        }
+    }
+    
+    entry->key = *key;
+    entry->lastUsed = ++cache->useCounter;
+    return entry->buffer;
+}
+
+void FrameCache_Remove(frame_cache_t *cache, frame_cache_key_t *key) {
+    frame_cache_entry_t *entry = findEntry(cache, key);
+    
+    if (entry != 0) {
+        entry->lastUsed = 0;
+    }
+}
+
+uint32_t FrameCache_MemoryUsed(frame_cache_t *cache) {
+    return (uint32_t) cache->numEntries *
+            (cache->frameSize + sizeof(frame_cache_entry_t));
+}
+
+// Cache helper functions
+static frame_cache_entry_t *findEntry(frame_cache_t *cache, frame_cache_key_t *key) {
+    uint16_t i;
+    
+    // The cache is only a handful of frames, a linear search is fastest
+    for (i = 0; i < cache->numEntries; i++) {
+        if ((cache->entries[i].lastUsed != 0) &&
+                keysEqual(&cache->entries[i].key, key)) {
+            return &cache->entries[i];
+        }
+    }
+    
+    return 0;
+}
+
+static uint8_t keysEqual(frame_cache_key_t *a, frame_cache_key_t *b) {
+    return (a->x == b->x) && (a->y == b->y) && (a->yaw == b->yaw);
+}
@@ -0,0 +1,118 @@
+/**
+ * @defgroup frame_cache Frame Cache
+ * @file frame_cache.h
+ * @version 1
+ * 
+ * Created on October 16, 2026
+ * 
+ * Small least recently used cache of rendered framebuffers keyed on a
+ * quantized camera pose. When the camera can only stand on a lattice of poses
+ * (fixed move and rotate steps) the same pose is visited over and over, so a
+ * cache hit can skip Render_Engine_RenderFrame() entirely.
+ * 
+ * The cache does not allocate memory. The caller provides an array of entries
+ * and one block of storage large enough for numEntries frames. Normal usage is:
+ * - FrameCache_Lookup() to look for an already rendered frame
+ * - FrameCache_Insert() on a miss to get a buffer to render the frame into
+ * 
+ * @{
+ */
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stdint.h>
+
+typedef struct frame_cache_key {
+    int16_t x;
+    int16_t y;
+    uint16_t yaw;
+} frame_cache_key_t;
+
+typedef struct frame_cache_entry {
+    frame_cache_key_t key;
+    uint32_t lastUsed; ///< 0 when the entry is empty
+    uint8_t *buffer;
+} frame_cache_entry_t;
+
+typedef struct frame_cache {
+    frame_cache_entry_t *entries;
+    uint16_t numEntries;
+    uint32_t frameSize;
+    uint32_t useCounter;
+    uint32_t hits;
+    uint32_t misses;
+} frame_cache_t;
+
+/** @brief Initialize a frame cache
+ * 
+ * @param cache Cache to initialize.
+ * @param entries Array of numEntries entries used to track the frames.
+ * @param storage Block of numEntries * frameSize bytes to hold the frames.
+ * @param numEntries Number of frames the cache can hold, must be at least 1.
+ * @param frameSize Size of one frame in bytes (width * height).
+ */
+void FrameCache_Init(frame_cache_t *cache, frame_cache_entry_t *entries,
+        uint8_t *storage, uint16_t numEntries, uint32_t frameSize);
+
+/** @brief Empty the cache
+ * 
+ * Drops every cached frame, the statistics keep counting. Must be called
+ * whenever the world changes, as cached frames are only valid for the world
+ * they were rendered from.
+ * 
+ * @param cache Cache to empty.
+ */
+void FrameCache_Clear(frame_cache_t *cache);
+
+/** @brief Look for a frame rendered from a pose
+ * 
+ * Counts a hit or a miss and marks the frame as most recently used.
+ * 
+ * @param cache Cache to search.
+ * @param key Quantized pose of the camera.
+ * @return Buffer holding the frame or 0 if the pose is not cached.
+ */
+uint8_t *FrameCache_Lookup(frame_cache_t *cache, frame_cache_key_t *key);
+
+/** @brief Check if a pose is cached
+ * 
+ * Unlike FrameCache_Lookup() this does not count towards the statistics or
+ * change which frame is evicted next.
+ * 
+ * @param cache Cache to search.
+ * @param key Quantized pose of the camera.
+ * @return 1 if the pose is cached, 0 otherwise.
+ */
+uint8_t FrameCache_Contains(frame_cache_t *cache, frame_cache_key_t *key);
+
+/** @brief Reserve a buffer for a pose
+ * 
+ * Evicts the least recently used frame (or takes an empty entry) and assigns
+ * it to the pose. The contents of the returned buffer are stale and the caller
+ * must render the frame into it.
+ * 
+ * @param cache Cache to insert into.
+ * @param key Quantized pose of the camera.
+ * @return Buffer of frameSize bytes to render the frame into.
+ */
+uint8_t *FrameCache_Insert(frame_cache_t *cache, frame_cache_key_t *key);
+
+/** @brief Drop a frame from the cache
+ * 
+ * Used when a frame reserved with FrameCache_Insert() was not finished.
+ * 
+ * @param cache Cache to remove the frame from.
+ * @param key Quantized pose of the camera.
+ */
+void FrameCache_Remove(frame_cache_t *cache, frame_cache_key_t *key);
+
+/** @brief Memory used by the cache
+ * 
+ * @param cache Cache to measure.
+ * @return Bytes used by the frames and the bookkeeping entries.
+ */
+uint32_t FrameCache_MemoryUsed(frame_cache_t *cache);
+
+/** @} */
+#endif // FRAME_CACHE_H
@@ -0,0 +1,412 @@
+#include "maze_session.h"
+#include <string.h>
+
+static uint8_t KeyToMove(uint8_t key);
+static maze_session_t *NextSession(maze_sessions_t *sessions, uint32_t now);
+static void ShowSession(maze_sessions_t *sessions, maze_session_t *session,
+        uint32_t now);
+static uint8_t ShowCached(maze_sessions_t *sessions, maze_session_t *session,
+        uint32_t now);
+static void CacheFrame(maze_sessions_t *sessions, maze_session_t *session);
+#ifdef RENDER_ENGINE_THREADS
+static uint8_t WaitForShared(maze_sessions_t *sessions, maze_session_t *session);
+static void AddShared(maze_sessions_t *sessions, maze_session_t *session);
+static void ShowShared(maze_sessions_t *sessions, maze_session_t *session,
+        uint32_t now);
+#endif
+
+void MazeSession_Start(maze_session_t *session, uint8_t *buffer, uint16_t width,
+        uint16_t height, uint32_t now) {
+    MazeWorld_StartPose(&session->pose);
+    MazeWorld_SetCamera(&session->pose, &session->camera);
+    session->frame.width = width;
+    session->frame.height = height;
+    session->frame.buffer = buffer;
+    session->frame.layout = RenderLayoutRows;
+    session->keyHead = 0;
+    session->keyTail = 0;
+    session->state = MazeSessionPlaying;
+    session->stale = 1;
+    session->keyPending = 0;
+    session->queued = 0;
+    session->keyTime = 0;
+    session->startTime = now;
+    session->time = 0;
+    session->frames = 0;
+    session->droppedKeys = 0;
+    session->latencyTotal = 0;
+    session->latencyMax = 0;
+    session->latencyCount = 0;
+    session->latency = UINT32_MAX;
+}
+
+void MazeSession_Key(maze_session_t *session, uint8_t key, uint32_t now) {
+    uint8_t next = (session->keyHead + 1) % MAZE_SESSION_KEYS;
+    
+    if (next == session->keyTail) {
+        // Queue is full, the game loop has fallen far behind
+        session->droppedKeys++;
+        return;
+    }
+    session->keys[session->keyHead] = key;
+    session->keyTimes[session->keyHead] = now;
+    session->keyHead = next;
+}
+
+uint8_t MazeSession_ApplyKeys(maze_session_t *session, uint32_t now) {
+    maze_pose_t before;
+    uint32_t keyTime;
+    uint8_t moved = 0;
+    uint8_t move;
+    
+    // Apply every waiting key, only the pose they lead to is rendered
+    while ((session->keyTail != session->keyHead) &&
+            (session->state == MazeSessionPlaying)) {
+        move = KeyToMove(session->keys[session->keyTail]);
+        keyTime = session->keyTimes[session->keyTail];
+        session->keyTail = (session->keyTail + 1) % MAZE_SESSION_KEYS;
+        if (move == MAZE_NUM_MOVES) {
+            continue;
+        }
+        
+        // A move into a wall changes nothing, so it gets no frame to wait for
+        before = session->pose;
+        MazeWorld_ApplyMove(&session->pose, move);
+        if ((session->pose.x == before.x) && (session->pose.y == before.y) &&
+                (session->pose.yaw == before.yaw)) {
+            continue;
+        }
+        if (!session->keyPending) {
+            session->keyTime = keyTime;
+            session->keyPending = 1;
+        }
+        moved = 1;
+        if ((move != MazeTurnLeft) && (move != MazeTurnRight) &&
+                MazeWorld_AtExit(&session->pose)) {
+            session->state = MazeSessionWon;
+            session->time = now - session->startTime;
+        }
+    }
+    
+    if (moved) {
+        MazeWorld_SetCamera(&session->pose, &session->camera);
+        session->stale = 1;
+    }
+    return moved;
+}
+
+void MazeSession_Shown(maze_session_t *session, uint32_t now) {
+    session->stale = 0;
+    session->frames++;
+    
+    // Measure the time from the key arriving to the frame starting to go out
+    session->latency = UINT32_MAX;
+    if (session->keyPending) {
+        session->latency = now - session->keyTime;
+        session->latencyTotal += session->latency;
+        session->latencyCount++;
+        if (session->latency > session->latencyMax) {
+            session->latencyMax = session->latency;
+        }
+        session->keyPending = 0;
+    }
+}
+
+void MazeSessions_Init(maze_sessions_t *sessions, world_t *world,
+        maze_session_t *slots, uint16_t maxSessions, render_order_t *order,
+        frame_cache_t *cache, maze_session_show_t show, maze_session_finish_t finish) {
+    uint16_t i;
+    
+    sessions->world = world;
+    sessions->slots = slots;
+    sessions->maxSessions = maxSessions;
+    sessions->numSessions = 0;
+    sessions->next = 0;
+    sessions->rendering = 0;
+    sessions->order = order;
+    sessions->cache = cache;
+    sessions->show = show;
+    sessions->finish = finish;
+    sessions->renders = 0;
+    sessions->cacheFrames = 0;
+#ifdef RENDER_ENGINE_THREADS
+    sessions->numShared = 0;
+#endif
+    for (i = 0; i < maxSessions; i++) {
+        slots[i].state = MazeSessionClosed;
+        slots[i].queued = 0;
+    }
+}
+
+maze_session_t *MazeSessions_Open(maze_sessions_t *sessions, uint8_t *buffer,
+        uint16_t width, uint16_t height, void *user, uint32_t now) {
+    uint16_t i;
+    
+    for (i = 0; i < sessions->maxSessions; i++) {
+        if ((sessions->slots[i].state == MazeSessionClosed) &&
+                !sessions->slots[i].queued) {
+            MazeSession_Start(&sessions->slots[i], buffer, width, height, now);
+            sessions->slots[i].user = user;
+            sessions->numSessions++;
+            return &sessions->slots[i];
+        }
+    }
+    return 0;
+}
+
+void MazeSessions_Close(maze_sessions_t *sessions, maze_session_t *session) {
+    if (session->state == MazeSessionClosed) {
+        return;
+    }
+    if (sessions->rendering == session) {
+        sessions->rendering = 0;
+    }
+    session->state = MazeSessionClosed;
+    sessions->numSessions--;
+}
+
+uint8_t MazeSessions_Step(maze_sessions_t *sessions, uint32_t numTriangles,
+        uint32_t now) {
+    maze_session_t *session = sessions->rendering;
+    
+    if (session == 0) {
+        session = NextSession(sessions, now);
+        if (session == 0) {
+            return 1;
+        }
+        if (ShowCached(sessions, session, now)) {
+            return 0;
+        }
+        Render_Engine_BeginFrame(&sessions->render, sessions->world,
+                &session->camera, &session->frame, sessions->order);
+        sessions->rendering = session;
+    }
+    
+    if (!Render_Engine_StepFrame(&sessions->render, numTriangles)) {
+        return 0;
+    }
+    sessions->rendering = 0;
+    sessions->renders++;
+    CacheFrame(sessions, session);
+    ShowSession(sessions, session, now);
+    return 0;
+}
+
+#ifdef RENDER_ENGINE_THREADS
+uint16_t MazeSessions_Dispatch(maze_sessions_t *sessions,
+        render_workers_t *workers, uint32_t now) {
+    maze_session_t *session;
+    uint16_t count = 0;
+    
+    // Every session that moved is either shown from the cache or queued, so
+    // each one comes up at most once
+    while ((session = NextSession(sessions, now)) != 0) {
+        if (ShowCached(sessions, session, now) || WaitForShared(sessions, session)) {
+            continue;
+        }
+        session->job.world = sessions->world;
+        session->job.camera = session->camera;
+        session->job.frame = session->frame;
+        session->job.user = session;
+        if (!Render_Engine_SubmitJob(workers, &session->job)) {
+            // Serve this session first next time
+            sessions->next = session - sessions->slots;
+            break;
+        }
+        session->queued = 1;
+        session->waiting = 0;
+        AddShared(sessions, session);
+        count++;
+    }
+    return count;
+}
+
+uint16_t MazeSessions_Collect(maze_sessions_t *sessions,
+        render_workers_t *workers, uint32_t now) {
+    render_job_t *jobs[32];
+    maze_session_t *session;
+    uint16_t count = 0;
+    uint16_t numJobs, i;
+    
+    do {
+        numJobs = Render_Engine_CollectJobs(workers, jobs, 32);
+        for (i = 0; i < numJobs; i++) {
+            session = jobs[i]->user;
+            session->queued = 0;
+            
+            // The waiting sessions go first, show may close the session
+            ShowShared(sessions, session, now);
+            if (session->state == MazeSessionClosed) {
+                continue;
+            }
+            sessions->renders++;
+            CacheFrame(sessions, session);
+            ShowSession(sessions, session, now);
+        }
+        count += numJobs;
+    } while (numJobs == 32);
+    return count;
+}
+#endif
+
+static uint8_t KeyToMove(uint8_t key) {
+    switch (key) {
+        case 'w':
+        case 'W':
+            return MazeForward;
+        case 's':
+        case 'S':
+            return MazeBackward;
+        case 'a':
+        case 'A':
+            return MazeLeft;
+        case 'd':
+        case 'D':
+            return MazeRight;
+        case '<':
+        case ',':
+            return MazeTurnLeft;
+        case '>':
+        case '.':
+            return MazeTurnRight;
+        default:
+            return MAZE_NUM_MOVES;
+    }
+}
+
+static maze_session_t *NextSession(maze_sessions_t *sessions, uint32_t now) {
+    maze_session_t *session;
+    uint16_t i, slot;
+    
+    // Start after the session served last so every player gets a turn
+    for (i = 0; i < sessions->maxSessions; i++) {
+        slot = (sessions->next + i) % sessions->maxSessions;
+        session = &sessions->slots[slot];
+        if ((session->state != MazeSessionPlaying) || session->queued) {
+            continue;
+        }
+        MazeSession_ApplyKeys(session, now);
+        if (session->state == MazeSessionWon) {
+            session->stale = 0;
+            if (sessions->finish != 0) {
+                sessions->finish(sessions, session);
+            }
+            continue;
+        }
+        if (session->stale) {
+            sessions->next = (slot + 1) % sessions->maxSessions;
+            return session;
+        }
+    }
+    return 0;
+}
+
+static void ShowSession(maze_sessions_t *sessions, maze_session_t *session,
+        uint32_t now) {
+    MazeSession_Shown(session, now);
+    if (sessions->show != 0) {
+        sessions->show(sessions, session);
+    }
+}
+
+static uint8_t ShowCached(maze_sessions_t *sessions, maze_session_t *session,
+        uint32_t now) {
+    frame_cache_key_t key;
+    uint8_t *cached;
+    
+    // Every session sees the same world, so a frame rendered for one player is
+    // right for any other at the same pose
+    if ((sessions->cache == 0) || ((uint32_t) session->frame.width *
+            session->frame.height != sessions->cache->frameSize)) {
+        return 0;
+    }
+    key.x = session->pose.x;
+    key.y = session->pose.y;
+    key.yaw = session->pose.yaw;
+    cached = FrameCache_Lookup(sessions->cache, &key);
+    if (cached == 0) {
+        return 0;
+    }
+    memcpy(session->frame.buffer, cached, sessions->cache->frameSize);
+    sessions->cacheFrames++;
+    ShowSession(sessions, session, now);
+    return 1;
+}
+
+static void CacheFrame(maze_sessions_t *sessions, maze_session_t *session) {
+    frame_cache_key_t key;
+    
+    if ((sessions->cache == 0) || ((uint32_t) session->frame.width *
+            session->frame.height != sessions->cache->frameSize)) {
+        return;
+    }
+    key.x = session->pose.x;
+    key.y = session->pose.y;
+    key.yaw = session->pose.yaw;
+    memcpy(FrameCache_Insert(sessions->cache, &key), session->frame.buffer,
+            sessions->cache->frameSize);
+}
+
+#ifdef RENDER_ENGINE_THREADS
+static uint8_t WaitForShared(maze_sessions_t *sessions, maze_session_t *session) {
+    maze_session_t *rendering;
+    uint16_t i;
+    
+    // Players crowd the same poses, like the start and the corridors to the
+    // exit, and one render can serve all of them
+    for (i = 0; i < sessions->numShared; i++) {
+        rendering = sessions->sharedSessions[i];
+        if ((sessions->sharedKeys[i].x == session->pose.x) &&
+                (sessions->sharedKeys[i].y == session->pose.y) &&
+                (sessions->sharedKeys[i].yaw == session->pose.yaw) &&
+                (rendering->frame.width == session->frame.width) &&
+                (rendering->frame.height == session->frame.height)) {
+            session->waiting = rendering->waiting;
+            rendering->waiting = session;
+            session->queued = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void AddShared(maze_sessions_t *sessions, maze_session_t *session) {
+    // With the table full the frame is only rendered for its own session
+    if (sessions->numShared == MAZE_SESSIONS_SHARED) {
+        return;
+    }
+    sessions->sharedKeys[sessions->numShared].x = session->pose.x;
+    sessions->sharedKeys[sessions->numShared].y = session->pose.y;
+    sessions->sharedKeys[sessions->numShared].yaw = session->pose.yaw;
+    sessions->sharedSessions[sessions->numShared] = session;
+    sessions->numShared++;
+}
+
+static void ShowShared(maze_sessions_t *sessions, maze_session_t *session,
+        uint32_t now) {
+    maze_session_t *waiting;
+    uint16_t i;
+    
+    for (i = 0; i < sessions->numShared; i++) {
+        if (sessions->sharedSessions[i] == session) {
+            sessions->numShared--;
+            sessions->sharedKeys[i] = sessions->sharedKeys[sessions->numShared];
+            sessions->sharedSessions[i] = sessions->sharedSessions[sessions->numShared];
+            break;
+        }
+    }
+    
+    // The frame is complete even if its own session closed in the meantime
+    while ((waiting = session->waiting) != 0) {
+        session->waiting = waiting->waiting;
+        waiting->queued = 0;
+        if (waiting->state == MazeSessionClosed) {
+            continue;
+        }
+        memcpy(waiting->frame.buffer, session->frame.buffer,
+                (size_t) session->frame.width * session->frame.height);
+        sessions->cacheFrames++;
+        ShowSession(sessions, waiting, now);
+    }
+}
+#endif
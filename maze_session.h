@@ -0,0 +1,258 @@
+/**
+ * @defgroup maze_session Maze Session
+ * @ingroup maze_game
+ * @file maze_session.h
+ * @version 1
+ * 
+ * Created on October 16, 2026
+ * 
+ * State of one player of the maze, kept apart from the world so many players
+ * can walk the same maze at once. A session is the player's pose and camera,
+ * the frame they see, the keys waiting to be applied and the time and latency
+ * counters, about 200 bytes plus the frame (300 with RENDER_ENGINE_THREADS).
+ * The world, the grid behind it and anything loaded from them are shared and
+ * never changed by a session.
+ * 
+ * One player is served with:
+ * - MazeSession_Start() when the game starts
+ * - MazeSession_Key() for every key received, safe from an interrupt
+ * - MazeSession_ApplyKeys() in the game loop to move the player
+ * - MazeSession_Shown() once the frame of the new pose goes out
+ * 
+ * Many players are served round robin from one render loop (maze_sessions_t).
+ * The loop owns the only render order and render state, so rendering costs
+ * the same memory however many players there are:
+ * - MazeSessions_Init() to set up the loop with an array of sessions
+ * - MazeSessions_Open() and MazeSessions_Close() as players come and go
+ * - MazeSessions_Step() as often as possible, it paints a few triangles of the
+ *   frame of one player at a time
+ * 
+ * With RENDER_ENGINE_THREADS the frames can instead be painted by render
+ * workers (render_workers_t), many players at once, while the calling thread
+ * goes on reading keys and sending frames:
+ * - MazeSessions_Dispatch() to queue the frames of the players that moved
+ * - MazeSessions_Collect() to show the frames the workers finished
+ * 
+ * @{
+ */
+
+#ifndef MAZE_SESSION_H
+#define MAZE_SESSION_H
+
+#include <stdint.h>
+#include "render_engine.h"
+#include "frame_cache.h"
+#include "maze_world.h"
+
+#define MAZE_SESSION_KEYS 16 ///< keys that can wait for the game loop
+#ifndef MAZE_SESSIONS_SHARED
+#define MAZE_SESSIONS_SHARED 64 ///< queued frames other sessions at the same pose can wait for
+#endif
+
+/// What a session is doing
+enum maze_session_state {
+    MazeSessionClosed,
+    MazeSessionPlaying,
+    MazeSessionWon ///< reached the exit, keys are no longer applied
+};
+
+typedef struct maze_session {
+    maze_pose_t pose; ///< lattice pose of the camera
+    camera_t camera; ///< camera at the pose
+    framebuffer_t frame; ///< frame shown to the player
+    uint8_t keys[MAZE_SESSION_KEYS]; ///< keys from the receiver
+    uint32_t keyTimes[MAZE_SESSION_KEYS]; ///< time each key arrived
+    volatile uint8_t keyHead; ///< next key entry the receiver fills
+    volatile uint8_t keyTail; ///< next key entry the game loop reads
+    uint8_t state; ///< enum maze_session_state
+    uint8_t stale; ///< frame does not show the pose yet
+    uint8_t keyPending; ///< a key is waiting for its frame
+    uint8_t queued; ///< a render worker has the frame (or one at the same pose), the pose must not change
+    uint32_t keyTime; ///< time the key being handled arrived
+    uint32_t startTime; ///< time the session started
+    uint32_t time; ///< time taken to reach the exit
+    uint32_t frames; ///< frames shown
+    uint32_t droppedKeys; ///< keys lost because the queue was full
+    uint32_t latencyTotal; ///< sum of key to frame latencies
+    uint32_t latencyMax; ///< worst key to frame latency
+    uint32_t latencyCount; ///< number of latencies measured
+    uint32_t latency; ///< latency of the frame shown last, UINT32_MAX if it answered no key
+    void *user; ///< data of the owner, like the connection of the player
+#ifdef RENDER_ENGINE_THREADS
+    render_job_t job; ///< frame handed to the render workers
+    struct maze_session *waiting; ///< next session waiting for the same frame, the list starts at the session it is rendered for
+#endif
+} maze_session_t;
+
+typedef struct maze_sessions maze_sessions_t;
+
+/// Called by MazeSessions_Step() with a session whose frame is ready to send
+typedef void (*maze_session_show_t)(maze_sessions_t *sessions, maze_session_t *session);
+
+/// Called by MazeSessions_Step() with a session that reached the exit
+typedef void (*maze_session_finish_t)(maze_sessions_t *sessions, maze_session_t *session);
+
+struct maze_sessions {
+    world_t *world; ///< shared by every session, never changed
+    maze_session_t *slots; ///< maxSessions sessions, closed ones are free
+    uint16_t maxSessions;
+    uint16_t numSessions; ///< sessions open
+    uint16_t next; ///< slot the round robin looks at first
+    maze_session_t *rendering; ///< session whose frame is being painted, 0 if none
+    render_context_t render; ///< frame being painted
+    render_order_t *order; ///< RENDER_ORDER_SIZE(world) entries
+    frame_cache_t *cache; ///< frames shared by every session, 0 if unused
+    maze_session_show_t show;
+    maze_session_finish_t finish;
+    uint32_t renders; ///< frames rendered
+    uint32_t cacheFrames; ///< frames copied from the cache, or from a frame rendered for another session, instead
+#ifdef RENDER_ENGINE_THREADS
+    frame_cache_key_t sharedKeys[MAZE_SESSIONS_SHARED]; ///< poses of queued frames
+    maze_session_t *sharedSessions[MAZE_SESSIONS_SHARED]; ///< session each queued frame is rendered for
+    uint16_t numShared;
+#endif
+};
+
+/** @brief Start a player at the start of the maze
+ * 
+ * The pose is taken from the grid of the world loaded last.
+ * 
+ * @param session Session to start.
+ * @param buffer Frame of width * height bytes shown to the player.
+ * @param width Width of the frame.
+ * @param height Height of the frame.
+ * @param now Current time, in any unit that fits the latency counters.
+ */
+void MazeSession_Start(maze_session_t *session, uint8_t *buffer, uint16_t width,
+        uint16_t height, uint32_t now);
+
+/** @brief Queue a key from the player
+ * 
+ * Only queues the key, so it may be called from an interrupt. Keys arriving
+ * while the queue is full are counted and dropped.
+ * 
+ * @param session Session the key is for.
+ * @param key Character received.
+ * @param now Time the key arrived.
+ */
+void MazeSession_Key(maze_session_t *session, uint8_t key, uint32_t now);
+
+/** @brief Move the player by every waiting key
+ * 
+ * 'w', 's', 'a' and 'd' move, '<' and '>' (or ',' and '.') turn, other keys
+ * are ignored. Moves collide with the walls of the maze, a move fully blocked by
+ * a wall is ignored as well and gets no frame. Keys after the one reaching the
+ * exit are dropped and the session is won.
+ * 
+ * @param session Session to apply the keys of.
+ * @param now Current time.
+ * @return 1 if the pose changed, the camera and stale are then updated.
+ */
+uint8_t MazeSession_ApplyKeys(maze_session_t *session, uint32_t now);
+
+/** @brief Note that the frame of the pose went out
+ * 
+ * Counts the frame and the latency from the first key that moved the player
+ * to now, which is kept in session->latency.
+ * 
+ * @param session Session that was shown its frame.
+ * @param now Time the frame started to go out.
+ */
+void MazeSession_Shown(maze_session_t *session, uint32_t now);
+
+/** @brief Set up a round robin loop of sessions
+ * 
+ * @param sessions Loop to set up.
+ * @param world World every session plays in, already loaded.
+ * @param slots Array of maxSessions sessions.
+ * @param maxSessions Most players at once.
+ * @param order Array of RENDER_ORDER_SIZE(world) entries shared by every
+ * frame.
+ * @param cache Cache of frames shared by every session, 0 for none. Only used
+ * for sessions whose frames are cache->frameSize bytes.
+ * @param show Called when the frame of a session is ready.
+ * @param finish Called when a session reaches the exit, may close it.
+ */
+void MazeSessions_Init(maze_sessions_t *sessions, world_t *world,
+        maze_session_t *slots, uint16_t maxSessions, render_order_t *order,
+        frame_cache_t *cache, maze_session_show_t show, maze_session_finish_t finish);
+
+/** @brief Add a player
+ * 
+ * Starts a session in a free slot, its first frame is sent by
+ * MazeSessions_Step().
+ * 
+ * @param sessions Loop to add the player to.
+ * @param buffer Frame of width * height bytes shown to the player.
+ * @param width Width of the frame.
+ * @param height Height of the frame.
+ * @param user Data of the owner, kept in session->user.
+ * @param now Current time.
+ * @return The session, 0 if every slot is in use.
+ */
+maze_session_t *MazeSessions_Open(maze_sessions_t *sessions, uint8_t *buffer,
+        uint16_t width, uint16_t height, void *user, uint32_t now);
+
+/** @brief Remove a player
+ * 
+ * A frame being painted for the session is dropped. A frame queued on render
+ * workers is still painted into the buffer of the session, which must stay
+ * valid until MazeSessions_Collect() returns it, and the slot is not reused
+ * before then. Must not be called from an interrupt.
+ * 
+ * @param sessions Loop the player is in.
+ * @param session Session from MazeSessions_Open().
+ */
+void MazeSessions_Close(maze_sessions_t *sessions, maze_session_t *session);
+
+/** @brief Take one turn of the render loop
+ * 
+ * Without a frame in progress, applies the keys of the sessions in turn
+ * starting after the last one served, and starts on the frame of the first one
+ * that moved. A frame in the cache is copied instead of rendered. Then paints
+ * up to numTriangles triangles of the frame and calls show once it is done.
+ * 
+ * @param sessions Loop to run.
+ * @param numTriangles Most triangles to paint before returning.
+ * @param now Current time.
+ * @return 1 if no session needs a frame, 0 if there is more to do.
+ */
+uint8_t MazeSessions_Step(maze_sessions_t *sessions, uint32_t numTriangles,
+        uint32_t now);
+
+#ifdef RENDER_ENGINE_THREADS
+/** @brief Queue the frames of the players that moved on render workers
+ * 
+ * Applies the keys of every session like MazeSessions_Step() does, a frame in
+ * the cache is copied and shown right away and the others are submitted to
+ * the workers. A session at the same pose as a frame already queued waits for
+ * that frame instead of queuing its own. A session whose frame is queued keeps
+ * its keys waiting until the frame is collected, so the frame always shows the
+ * pose it was queued for.
+ * 
+ * @param sessions Loop to run.
+ * @param workers Workers to paint the frames.
+ * @param now Current time.
+ * @return Number of frames queued. Sessions left over when the workers have
+ * maxJobs jobs out are queued by a later call.
+ */
+uint16_t MazeSessions_Dispatch(maze_sessions_t *sessions,
+        render_workers_t *workers, uint32_t now);
+
+/** @brief Show the frames render workers finished
+ * 
+ * Calls show for each finished frame, from the calling thread, and keeps it in
+ * the cache. The frame is copied to the sessions waiting for it and shown to
+ * them as well. Frames of sessions closed in the meantime are dropped.
+ * 
+ * @param sessions Loop the frames are for.
+ * @param workers Workers that painted the frames.
+ * @param now Current time.
+ * @return Number of frames collected.
+ */
+uint16_t MazeSessions_Collect(maze_sessions_t *sessions,
+        render_workers_t *workers, uint32_t now);
+#endif
+
+/** @} */
+#endif // MAZE_SESSION_H
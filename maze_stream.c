@@ -0,0 +1,187 @@
+#include "maze_stream.h"
+#include <math.h>
+#include <string.h>
+
+static uint16_t PageIn(maze_stream_t *stream, const vector_t *location,
+        uint8_t load);
+static uint16_t ChunkDistance(uint16_t x, uint16_t y, uint16_t cameraX,
+        uint16_t cameraY);
+static maze_chunk_t *FindChunk(maze_stream_t *stream, uint16_t x, uint16_t y);
+static uint8_t EvictChunk(maze_stream_t *stream, uint16_t cameraX,
+        uint16_t cameraY);
+static void LoadChunk(maze_stream_t *stream, uint16_t x, uint16_t y);
+static uint16_t CameraChunk(rounding_t location, uint16_t exit, uint16_t cells);
+
+void MazeStream_Init(maze_stream_t *stream, world_t *world,
+        const maze_grid_t *grid, maze_chunk_t *chunks, render_instance_t *pool,
+        uint16_t maxChunks, uint16_t radius) {
+    stream->world = world;
+    stream->grid = grid;
+    stream->chunks = chunks;
+    stream->pool = pool;
+    stream->maxChunks = maxChunks;
+    stream->numChunks = 0;
+    stream->radius = radius;
+    stream->peakChunks = 0;
+    stream->updates = 0;
+    stream->stalls = 0;
+    stream->loads = 0;
+    stream->evictions = 0;
+    stream->misses = 0;
+    MazeWorld_LoadPlaced(world, grid, pool, 0);
+}
+
+uint16_t MazeStream_Update(maze_stream_t *stream, const vector_t *location) {
+    uint16_t loaded;
+    
+    stream->updates++;
+    loaded = PageIn(stream, location, 1);
+    if (loaded > 0) {
+        stream->stalls++;
+        stream->loads += loaded;
+        if (stream->numChunks > stream->peakChunks) {
+            stream->peakChunks = stream->numChunks;
+        }
+        maze_chunk_t *last = &stream->chunks[stream->numChunks - 1];
+        MazeWorld_LoadPlaced(stream->world, stream->grid, stream->pool,
+                last->start + last->count);
+    }
+    return loaded;
+}
+
+uint8_t MazeStream_Resident(maze_stream_t *stream, const vector_t *location) {
+    return PageIn(stream, location, 0) == 0;
+}
+
+uint32_t MazeStream_MemoryUsed(maze_stream_t *stream) {
+    maze_chunk_t *last;
+    
+    if (stream->numChunks == 0) {
+        return 0;
+    }
+    last = &stream->chunks[stream->numChunks - 1];
+    return (last->start + last->count) * sizeof(render_instance_t);
+}
+
+static uint16_t PageIn(maze_stream_t *stream, const vector_t *location,
+        uint8_t load) {
+    const maze_grid_t *grid = stream->grid;
+    uint16_t cameraX = CameraChunk(location->x, grid->exitX, grid->width);
+    uint16_t cameraY = CameraChunk(location->y, grid->exitY, grid->height);
+    uint16_t lastX = (grid->width - 1) / MAZE_CHUNK_SIZE;
+    uint16_t lastY = (grid->height - 1) / MAZE_CHUNK_SIZE;
+    uint16_t count = 0;
+    uint16_t ring, x, y;
+    
+    // Wanted chunks ring by ring from the camera out, so a pool that is too
+    // small still holds the nearest ones
+    for (ring = 0; ring <= stream->radius; ring++) {
+        for (y = (cameraY > ring) ? cameraY - ring : 0;
+                (y <= cameraY + ring) && (y <= lastY); y++) {
+            for (x = (cameraX > ring) ? cameraX - ring : 0;
+                    (x <= cameraX + ring) && (x <= lastX); x++) {
+                if ((ChunkDistance(x, y, cameraX, cameraY) != ring) ||
+                        (FindChunk(stream, x, y) != 0)) {
+                    continue;
+                }
+                if (!load) {
+                    count++;
+                } else if ((stream->numChunks == stream->maxChunks) &&
+                        !EvictChunk(stream, cameraX, cameraY)) {
+                    stream->misses++;
+                } else {
+                    LoadChunk(stream, x, y);
+                    count++;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+static uint16_t ChunkDistance(uint16_t x, uint16_t y, uint16_t cameraX,
+        uint16_t cameraY) {
+    uint16_t dx = (x > cameraX) ? x - cameraX : cameraX - x;
+    uint16_t dy = (y > cameraY) ? y - cameraY : cameraY - y;
+    
+    return (dx > dy) ? dx : dy;
+}
+
+static maze_chunk_t *FindChunk(maze_stream_t *stream, uint16_t x, uint16_t y) {
+    uint16_t i;
+    
+    for (i = 0; i < stream->numChunks; i++) {
+        if ((stream->chunks[i].x == x) && (stream->chunks[i].y == y)) {
+            return &stream->chunks[i];
+        }
+    }
+    return 0;
+}
+
+static uint8_t EvictChunk(maze_stream_t *stream, uint16_t cameraX,
+        uint16_t cameraY) {
+    uint16_t farthest = 0;
+    uint16_t distance = 0;
+    uint16_t i, d;
+    uint32_t count;
+    
+    // Only chunks outside the radius may go, the rest are all wanted
+    for (i = 0; i < stream->numChunks; i++) {
+        d = ChunkDistance(stream->chunks[i].x, stream->chunks[i].y, cameraX,
+                cameraY);
+        if (d > distance) {
+            farthest = i;
+            distance = d;
+        }
+    }
+    if (distance <= stream->radius) {
+        return 0;
+    }
+    
+    // Close the gap so the instances of the resident chunks stay in one run
+    count = stream->chunks[farthest].count;
+    for (i = farthest + 1; i < stream->numChunks; i++) {
+        memmove(&stream->pool[stream->chunks[i].start - count],
+                &stream->pool[stream->chunks[i].start],
+                stream->chunks[i].count * sizeof(render_instance_t));
+        stream->chunks[i].start -= count;
+        stream->chunks[i - 1] = stream->chunks[i];
+    }
+    stream->numChunks--;
+    stream->evictions++;
+    return 1;
+}
+
+static void LoadChunk(maze_stream_t *stream, uint16_t x, uint16_t y) {
+    const maze_grid_t *grid = stream->grid;
+    maze_chunk_t *chunk = &stream->chunks[stream->numChunks];
+    uint16_t left = x * MAZE_CHUNK_SIZE;
+    uint16_t bottom = y * MAZE_CHUNK_SIZE;
+    uint16_t width = grid->width - left;
+    uint16_t height = grid->height - bottom;
+    
+    // Chunks on the far edges of the grid may be cut short
+    chunk->x = x;
+    chunk->y = y;
+    chunk->start = 0;
+    if (stream->numChunks > 0) {
+        chunk->start = chunk[-1].start + chunk[-1].count;
+    }
+    chunk->count = MazeWorld_PlaceCells(grid, left, bottom,
+            (width < MAZE_CHUNK_SIZE) ? width : MAZE_CHUNK_SIZE,
+            (height < MAZE_CHUNK_SIZE) ? height : MAZE_CHUNK_SIZE,
+            &stream->pool[chunk->start]);
+    stream->numChunks++;
+}
+
+static uint16_t CameraChunk(rounding_t location, uint16_t exit, uint16_t cells) {
+    // The exit cell is centered on the origin
+    int32_t cell = (int32_t) floor((location / MAZE_CELL_SIZE) + 0.5) + exit;
+    
+    if (cell < 0) {
+        cell = 0;
+    } else if (cell >= cells) {
+        cell = cells - 1;
+    }
+    return cell / MAZE_CHUNK_SIZE;
+}
@@ -0,0 +1,109 @@
+/**
+ * @defgroup maze_stream Maze Stream
+ * @ingroup maze_game
+ * @file maze_stream.h
+ * @version 1
+ * 
+ * Created on October 16, 2026
+ * 
+ * Keeps only the part of a large maze around the camera in the world. The grid
+ * of the whole maze is small (2 bits a cell) and can stay in flash, but the
+ * instances of thousands of cells do not fit in RAM next to the framebuffer.
+ * The grid is split into chunks of MAZE_CHUNK_SIZE by MAZE_CHUNK_SIZE cells and
+ * the instances of the chunks near the camera are placed in a fixed pool:
+ * - MazeStream_Init() to point a world at an empty pool
+ * - MazeStream_Update() whenever the camera moved, before rendering
+ * - MazeStream_Resident() to find out if an update would change the world
+ * 
+ * Chunks stay resident until the pool needs room for a nearer one, so walking
+ * back and forth over a chunk edge does not page anything in. The stream
+ * counts what it does, for tuning the pool size and radius.
+ * 
+ * @{
+ */
+
+#ifndef MAZE_STREAM_H
+#define MAZE_STREAM_H
+
+#include <stdint.h>
+#include "render_engine.h"
+#include "maze_world.h"
+
+#define MAZE_CHUNK_SIZE 8 ///< cells along each side of a chunk
+
+// Instances a pool of the given number of chunks needs
+#define MAZE_STREAM_INSTANCES(numChunks) \
+        ((uint32_t) (numChunks) * MAZE_GRID_INSTANCES(MAZE_CHUNK_SIZE, MAZE_CHUNK_SIZE))
+
+typedef struct maze_chunk {
+    uint16_t x; ///< column of the chunk, in chunks
+    uint16_t y; ///< row of the chunk, in chunks
+    uint32_t start; ///< first instance of the chunk in the pool
+    uint32_t count; ///< instances of the chunk
+} maze_chunk_t;
+
+typedef struct maze_stream {
+    world_t *world;
+    const maze_grid_t *grid; ///< layout of the whole maze
+    maze_chunk_t *chunks; ///< resident chunks, in pool order
+    render_instance_t *pool; ///< MAZE_STREAM_INSTANCES(maxChunks) instances
+    uint16_t maxChunks;
+    uint16_t numChunks; ///< chunks resident
+    uint16_t radius; ///< chunks wanted on each side of the camera's chunk
+    uint16_t peakChunks; ///< most chunks resident at once
+    uint32_t updates; ///< calls to MazeStream_Update()
+    uint32_t stalls; ///< updates that had to page in a chunk
+    uint32_t loads; ///< chunks paged in
+    uint32_t evictions; ///< chunks dropped to make room
+    uint32_t misses; ///< wanted chunks left out because the pool was full
+} maze_stream_t;
+
+/** @brief Set up a stream with nothing resident
+ * 
+ * The world is loaded with no instances and the grid becomes the one the pose
+ * functions use, call MazeStream_Update() before the first frame.
+ * 
+ * @param stream Stream to set up.
+ * @param world World to keep loaded with the resident chunks.
+ * @param grid Layout of the maze, must stay valid.
+ * @param chunks Array of maxChunks chunks.
+ * @param pool Array of MAZE_STREAM_INSTANCES(maxChunks) instances.
+ * @param maxChunks Chunks that can be resident, at least
+ * (2 * radius + 1) * (2 * radius + 1) to hold all the wanted ones.
+ * @param radius Chunks to keep on each side of the camera's chunk.
+ */
+void MazeStream_Init(maze_stream_t *stream, world_t *world,
+        const maze_grid_t *grid, maze_chunk_t *chunks, render_instance_t *pool,
+        uint16_t maxChunks, uint16_t radius);
+
+/** @brief Page in the chunks around the camera
+ * 
+ * Chunks within the radius of the camera's chunk that are not resident are
+ * placed in the pool, nearest first, dropping the resident chunks farthest
+ * from the camera when the pool is full. The world is reloaded when anything
+ * changed, so this must not be called while a frame of the world is being
+ * rendered.
+ * 
+ * @param stream Stream to update.
+ * @param location Location of the camera.
+ * @return Number of chunks paged in, 0 if the world did not change.
+ */
+uint16_t MazeStream_Update(maze_stream_t *stream, const vector_t *location);
+
+/** @brief Check if the chunks around the camera are resident
+ * 
+ * @param stream Stream to check.
+ * @param location Location of the camera.
+ * @return 1 if MazeStream_Update() would not page in anything.
+ */
+uint8_t MazeStream_Resident(maze_stream_t *stream, const vector_t *location);
+
+/** @brief Memory used by the resident chunks
+ * 
+ * @param stream Stream to check.
+ * @return Bytes of instances in use in the pool.
+ */
+uint32_t MazeStream_MemoryUsed(maze_stream_t *stream);
+
+/** @} */
+#endif // MAZE_STREAM_H
@@ -0,0 +1,649 @@
+#include "maze_world.h"
+#include <math.h>
+
+#define CAMERA_FOV_HORIZONTAL 100
+#define CAMERA_FOV_VERTICAL 75
+#define CAMERA_HEIGHT 1.8
+#define CAMERA_MOVE 0.5
+#define CAMERA_ROTATE (360 / MAZE_POSE_YAW_STEPS)
+#define PLAYER_RADIUS 1 ///< world units the camera keeps away from walls
+
+// Define MAZE_FAR_DISTANCE to leave out walls farther away than that many
+// world units, and MAZE_FOG_BAND to paint the last that many units before it
+// in FOG_COLOR. Both are off by default so frames match the full world
+#ifndef MAZE_FAR_DISTANCE
+#define MAZE_FAR_DISTANCE 0
+#endif
+#ifndef MAZE_FOG_BAND
+#define MAZE_FOG_BAND 0
+#endif
+#define FOG_COLOR Black
+
+// World generation
+#define WALL_HEIGHT 3
+#define TILE_SIZE MAZE_CELL_SIZE
+#define WORLD_BACKGROUND Blue
+#define WIN_TILE Green
+#define REG_TILE Red
+#define POS_X_WALL Yellow
+#define NEG_X_WALL White
+#define POS_Y_WALL Cyan
+#define NEG_Y_WALL Magenta
+
+// Corners of the tile meshes, relative to the middle of the tile. Every corner
+// is a whole number of world units, so the meshes are packed on a grid of 1
+#define GRID_SCALE 1
+#define TILE_LOW (-(TILE_SIZE / 2) / GRID_SCALE)
+#define TILE_HIGH ((TILE_SIZE / 2) / GRID_SCALE)
+#define WALL_TOP (WALL_HEIGHT / GRID_SCALE)
+
+// Meshes a tile is built from, placed in this order
+enum maze_mesh {
+    MazeMeshBase,
+    MazeMeshPosXWall,
+    MazeMeshNegXWall,
+    MazeMeshPosYWall,
+    MazeMeshNegYWall,
+    MAZE_NUM_MESHES
+};
+
+static const render_packed_triangle_t baseMesh[2] = {
+    {{TILE_LOW, TILE_LOW, 0}, {TILE_HIGH, TILE_LOW, 0}, {TILE_LOW, TILE_HIGH, 0}, REG_TILE},
+    {{TILE_HIGH, TILE_HIGH, 0}, {TILE_HIGH, TILE_LOW, 0}, {TILE_LOW, TILE_HIGH, 0}, REG_TILE}
+};
+static const render_packed_triangle_t posXWallMesh[2] = {
+    {{TILE_HIGH, TILE_HIGH, 0}, {TILE_HIGH, TILE_HIGH, WALL_TOP},
+            {TILE_HIGH, TILE_LOW, 0}, POS_X_WALL},
+    {{TILE_HIGH, TILE_HIGH, WALL_TOP}, {TILE_HIGH, TILE_LOW, WALL_TOP},
+            {TILE_HIGH, TILE_LOW, 0}, POS_X_WALL}
+};
+static const render_packed_triangle_t negXWallMesh[2] = {
+    {{TILE_LOW, TILE_HIGH, 0}, {TILE_LOW, TILE_HIGH, WALL_TOP},
+            {TILE_LOW, TILE_LOW, 0}, NEG_X_WALL},
+    {{TILE_LOW, TILE_HIGH, WALL_TOP}, {TILE_LOW, TILE_LOW, WALL_TOP},
+            {TILE_LOW, TILE_LOW, 0}, NEG_X_WALL}
+};
+static const render_packed_triangle_t posYWallMesh[2] = {
+    {{TILE_HIGH, TILE_HIGH, 0}, {TILE_HIGH, TILE_HIGH, WALL_TOP},
+            {TILE_LOW, TILE_HIGH, 0}, POS_Y_WALL},
+    {{TILE_HIGH, TILE_HIGH, WALL_TOP}, {TILE_LOW, TILE_HIGH, WALL_TOP},
+            {TILE_LOW, TILE_HIGH, 0}, POS_Y_WALL}
+};
+static const render_packed_triangle_t negYWallMesh[2] = {
+    {{TILE_HIGH, TILE_LOW, 0}, {TILE_HIGH, TILE_LOW, WALL_TOP},
+            {TILE_LOW, TILE_LOW, 0}, NEG_Y_WALL},
+    {{TILE_HIGH, TILE_LOW, WALL_TOP}, {TILE_LOW, TILE_LOW, WALL_TOP},
+            {TILE_LOW, TILE_LOW, 0}, NEG_Y_WALL}
+};
+static const render_mesh_t meshes[MAZE_NUM_MESHES] = {
+    {0, 2, baseMesh},
+    {0, 2, posXWallMesh},
+    {0, 2, negXWallMesh},
+    {0, 2, posYWallMesh},
+    {0, 2, negYWallMesh}
+};
+
+// Size of the built in maze in cells, the exit is in the middle
+#define MAZE_WIDTH 5
+#define MAZE_HEIGHT 5
+
+// Lattice step of a move for each camera rotation
+static int8_t moveX[MAZE_POSE_YAW_STEPS];
+static int8_t moveY[MAZE_POSE_YAW_STEPS];
+
+// Built in maze and the grid the world was last loaded from
+static uint8_t mazeCells[MAZE_GRID_BYTES(MAZE_WIDTH, MAZE_HEIGHT)];
+static maze_grid_t maze;
+static const maze_grid_t *worldGrid;
+
+static void AddTile(maze_grid_t *grid, int x, int y,
+        uint8_t posXWall, uint8_t negXWall, uint8_t posYWall, uint8_t negYWall);
+static uint32_t AddInstance(render_instance_t *instances, uint32_t index,
+        const maze_grid_t *grid, uint16_t x, uint16_t y, uint8_t mesh);
+static uint32_t AddWall(triangle_t *triangles, uint32_t index, vector_t from,
+        vector_t to, uint8_t color);
+static void SetWorld(world_t *world, const maze_grid_t *grid);
+static void SetMoves(void);
+static uint8_t Blocked(int32_t gridX, int32_t gridY);
+static uint8_t Unvisited(const maze_grid_t *grid, uint16_t x, uint16_t y);
+static uint8_t PickNeighbour(const maze_grid_t *grid, uint16_t x, uint16_t y,
+        uint8_t unvisited, uint32_t *random);
+static uint32_t NextRandom(uint32_t *state);
+
+uint16_t MazeWorld_Build(world_t *world, render_instance_t *instances) {
+    SetMoves();
+    
+    // Lay out the maze, tiles are placed relative to the exit
+    MazeGrid_Init(&maze, mazeCells, MAZE_WIDTH, MAZE_HEIGHT, MAZE_WIDTH / 2,
+            MAZE_HEIGHT / 2);
+    AddTile(&maze, 0, 0, 0, 1, 1, 1);
+    
+    AddTile(&maze, 1, 0, 1, 0, 0, 0);
+    AddTile(&maze, 1, -1, 1, 0, 0, 1);
+    AddTile(&maze, 0, -1, 0, 0, 0, 1);
+    AddTile(&maze, -1, -1, 0, 1, 0, 1);
+    AddTile(&maze, -1, 0, 0, 1, 0, 0);
+    AddTile(&maze, -1, 1, 0, 1, 1, 0);
+    AddTile(&maze, 0, 1, 0, 0, 0, 0);
+    AddTile(&maze, 1, 1, 1, 0, 1, 0);
+    
+    AddTile(&maze, 0, 2, 0, 1, 1, 0);
+    AddTile(&maze, 1, 2, 0, 0, 1, 0);
+    AddTile(&maze, 2, 2, 1, 0, 1, 0);
+    AddTile(&maze, 2, 1, 1, 0, 0, 0);
+    AddTile(&maze, 2, 0, 1, 0, 0, 0);
+    AddTile(&maze, 2, -1, 1, 0, 0, 0);
+    AddTile(&maze, 2, -2, 1, 0, 0, 1);
+    AddTile(&maze, 1, -2, 0, 0, 0, 1);
+    AddTile(&maze, 0, -2, 0, 0, 0, 1);
+    AddTile(&maze, -1, -2, 0, 0, 0, 1);
+    AddTile(&maze, -2, -2, 0, 1, 0, 1);
+    AddTile(&maze, -2, -1, 0, 1, 0, 0);
+    AddTile(&maze, -2, 0, 0, 1, 0, 0);
+    AddTile(&maze, -2, 1, 0, 1, 0, 0);
+    AddTile(&maze, -2, 2, 0, 1, 1, 0);
+    AddTile(&maze, -1, 2, 0, 0, 1, 0);
+    
+//    AddTile(&maze, 0, 3, 0, 0, 1, 0);
+//    AddTile(&maze, 1, 3, 0, 0, 1, 0);
+//    AddTile(&maze, 2, 3, 0, 0, 1, 0);
+//    AddTile(&maze, 3, 3, 1, 0, 1, 0);
+//    AddTile(&maze, 3, 2, 1, 0, 0, 0);
+//    AddTile(&maze, 3, 1, 1, 0, 0, 0);
+//    AddTile(&maze, 3, 0, 1, 0, 0, 0);
+//    AddTile(&maze, 3, -1, 1, 0, 0, 0);
+//    AddTile(&maze, 3, -2, 1, 0, 0, 0);
+//    AddTile(&maze, 3, -3, 1, 0, 0, 1);
+//    AddTile(&maze, 2, -3, 0, 0, 0, 1);
+//    AddTile(&maze, 1, -3, 0, 0, 0, 1);
+//    AddTile(&maze, 0, -3, 0, 0, 0, 1);
+//    AddTile(&maze, -1, -3, 0, 0, 0, 1);
+//    AddTile(&maze, -2, -3, 0, 0, 0, 1);
+//    AddTile(&maze, -3, -3, 0, 1, 0, 1);
+//    AddTile(&maze, -3, -2, 0, 1, 1, 0);
+//    AddTile(&maze, -3, -1, 0, 1, 0, 0);
+//    AddTile(&maze, -3, 0, 0, 1, 0, 0);
+//    AddTile(&maze, -3, 1, 0, 1, 0, 0);
+//    AddTile(&maze, -3, 2, 0, 1, 0, 0);
+//    AddTile(&maze, -3, 3, 0, 1, 1, 0);
+//    AddTile(&maze, -2, 3, 0, 0, 1, 0);
+//    AddTile(&maze, -1, 3, 0, 0, 1, 0);
+    
+    return MazeWorld_Load(world, &maze, instances);
+}
+
+uint32_t MazeWorld_Load(world_t *world, const maze_grid_t *grid,
+        render_instance_t *instances) {
+    uint32_t numInstances = MazeWorld_PlaceCells(grid, 0, 0, grid->width,
+            grid->height, instances);
+    return MazeWorld_LoadPlaced(world, grid, instances, numInstances);
+}
+
+uint32_t MazeWorld_PlaceCells(const maze_grid_t *grid, uint16_t left,
+        uint16_t bottom, uint16_t width, uint16_t height,
+        render_instance_t *instances) {
+    uint32_t i = 0;
+    uint16_t x, y;
+    uint8_t walls;
+    
+    // Every wall is placed once, by the cell on the side facing the exit so
+    // walls show the same color from wherever the player sees them
+    for (y = bottom; y < bottom + height; y++) {
+        for (x = left; x < left + width; x++) {
+            walls = MazeGrid_Walls(grid, x, y);
+            i += AddInstance(instances, i, grid, x, y, MazeMeshBase);
+            if ((walls & MazeWallPosX) && (x >= grid->exitX)) {
+                i += AddInstance(instances, i, grid, x, y, MazeMeshPosXWall);
+            }
+            if ((walls & MazeWallNegX) && (x <= grid->exitX)) {
+                i += AddInstance(instances, i, grid, x, y, MazeMeshNegXWall);
+            }
+            if ((walls & MazeWallPosY) && (y >= grid->exitY)) {
+                i += AddInstance(instances, i, grid, x, y, MazeMeshPosYWall);
+            }
+            if ((walls & MazeWallNegY) && (y <= grid->exitY)) {
+                i += AddInstance(instances, i, grid, x, y, MazeMeshNegYWall);
+            }
+        }
+    }
+    
+    return i;
+}
+
+uint32_t MazeWorld_LoadPlaced(world_t *world, const maze_grid_t *grid,
+        render_instance_t *instances, uint32_t numInstances) {
+    SetWorld(world, grid);
+    Render_Engine_LoadInstances(world, meshes, instances, numInstances);
+    return world->numTriangles;
+}
+
+uint32_t MazeWorld_LoadLevel(world_t *world, const maze_level_t *level) {
+    SetMoves();
+    SetWorld(world, &level->grid);
+    world->triangles = 0;
+    world->meshes = meshes;
+    world->instances = level->instances;
+    world->numInstances = level->numInstances;
+    world->numTriangles = level->numTriangles;
+    return world->numTriangles;
+}
+
+uint32_t MazeWorld_LoadMerged(world_t *world, const maze_grid_t *grid,
+        triangle_t *triangles) {
+    const int32_t half = TILE_SIZE / 2;
+    uint32_t i = 0;
+    uint16_t x, y, line, first;
+    uint8_t k, corner, wall;
+    
+    // Bases stay one per cell so walls are still sorted against them
+    for (y = 0; y < grid->height; y++) {
+        for (x = 0; x < grid->width; x++) {
+            render_instance_t base;
+            AddInstance(&base, 0, grid, x, y, MazeMeshBase);
+            for (k = 0; k < 2; k++) {
+                const int8_t *packed[3] = {baseMesh[k].p1, baseMesh[k].p2,
+                        baseMesh[k].p3};
+                vector_t *corners[3] = {&triangles[i].p1, &triangles[i].p2,
+                        &triangles[i].p3};
+                for (corner = 0; corner < 3; corner++) {
+                    corners[corner]->x = (packed[corner][0] * GRID_SCALE) + base.offset.x;
+                    corners[corner]->y = (packed[corner][1] * GRID_SCALE) + base.offset.y;
+                    corners[corner]->z = packed[corner][2] * GRID_SCALE;
+                }
+                triangles[i].color = (base.color != 0) ? base.color : baseMesh[k].color;
+                i++;
+            }
+        }
+    }
+    
+    // Walls along y, line is the edge before column line. Colors follow the
+    // same side of the exit rule as MazeWorld_Load()
+    for (line = 0; line <= grid->width; line++) {
+        float wallX = (((int32_t) line - grid->exitX) * TILE_SIZE) - half;
+        first = UINT16_MAX;
+        for (y = 0; y <= grid->height; y++) {
+            wall = (y < grid->height) && ((line == grid->width) ||
+                    (MazeGrid_Walls(grid, line, y) & MazeWallNegX));
+            if (wall && (first == UINT16_MAX)) {
+                first = y;
+            } else if (!wall && (first != UINT16_MAX)) {
+                vector_t from = {wallX,
+                        (((int32_t) first - grid->exitY) * TILE_SIZE) - half, 0};
+                vector_t to = {wallX, (((int32_t) y - grid->exitY) * TILE_SIZE) - half, 0};
+                i += AddWall(triangles, i, from, to,
+                        (line > grid->exitX) ? POS_X_WALL : NEG_X_WALL);
+                first = UINT16_MAX;
+            }
+        }
+    }
+    
+    // Walls along x, line is the edge before row line
+    for (line = 0; line <= grid->height; line++) {
+        float wallY = (((int32_t) line - grid->exitY) * TILE_SIZE) - half;
+        first = UINT16_MAX;
+        for (x = 0; x <= grid->width; x++) {
+            wall = (x < grid->width) && ((line == grid->height) ||
+                    (MazeGrid_Walls(grid, x, line) & MazeWallNegY));
+            if (wall && (first == UINT16_MAX)) {
+                first = x;
+            } else if (!wall && (first != UINT16_MAX)) {
+                vector_t from = {(((int32_t) first - grid->exitX) * TILE_SIZE) - half,
+                        wallY, 0};
+                vector_t to = {(((int32_t) x - grid->exitX) * TILE_SIZE) - half, wallY, 0};
+                i += AddWall(triangles, i, from, to,
+                        (line > grid->exitY) ? POS_Y_WALL : NEG_Y_WALL);
+                first = UINT16_MAX;
+            }
+        }
+    }
+    
+    SetWorld(world, grid);
+    world->numTriangles = i;
+    world->triangles = triangles;
+    world->instances = 0;
+    return i;
+}
+
+const maze_grid_t *MazeWorld_Grid(void) {
+    return worldGrid;
+}
+
+uint8_t MazeWorld_PoseCell(maze_pose_t *pose, uint16_t *x, uint16_t *y) {
+    const int32_t cellSize = TILE_SIZE * MAZE_POSE_SCALE;
+    
+    // Distance from the negative corner of the grid, the exit is at the origin
+    int32_t gridX = pose->x + (cellSize / 2) + (worldGrid->exitX * cellSize);
+    int32_t gridY = pose->y + (cellSize / 2) + (worldGrid->exitY * cellSize);
+    
+    if ((gridX <= 0) || (gridY <= 0) || (gridX % cellSize == 0) ||
+            (gridY % cellSize == 0) || (gridX / cellSize >= worldGrid->width) ||
+            (gridY / cellSize >= worldGrid->height)) {
+        return 0;
+    }
+    *x = gridX / cellSize;
+    *y = gridY / cellSize;
+    return 1;
+}
+
+uint8_t MazeWorld_AtExit(maze_pose_t *pose) {
+    uint16_t x, y;
+    
+    return MazeWorld_PoseCell(pose, &x, &y) && (x == worldGrid->exitX) &&
+            (y == worldGrid->exitY);
+}
+
+void MazeGrid_Init(maze_grid_t *grid, uint8_t *cells, uint16_t width,
+        uint16_t height, uint16_t exitX, uint16_t exitY) {
+    uint32_t i;
+    
+    grid->cells = cells;
+    grid->editCells = cells;
+    grid->width = width;
+    grid->height = height;
+    grid->exitX = exitX;
+    grid->exitY = exitY;
+    grid->startX = exitX;
+    grid->startY = 0;
+    for (i = 0; i < MAZE_GRID_BYTES(width, height); i++) {
+        cells[i] = 0;
+    }
+}
+
+void MazeGrid_SetWalls(maze_grid_t *grid, uint16_t x, uint16_t y, uint8_t walls,
+        uint8_t present) {
+    uint32_t cell;
+    uint8_t bits;
+    
+    // Negative sides belong to the neighbours, edges of the grid have no bits
+    if ((walls & MazeWallNegX) && (x > 0)) {
+        MazeGrid_SetWalls(grid, x - 1, y, MazeWallPosX, present);
+    }
+    if ((walls & MazeWallNegY) && (y > 0)) {
+        MazeGrid_SetWalls(grid, x, y - 1, MazeWallPosY, present);
+    }
+    bits = ((walls & MazeWallPosX) && (x + 1 < grid->width)) |
+            (((walls & MazeWallPosY) && (y + 1 < grid->height)) << 1);
+    
+    cell = x + ((uint32_t) y * grid->width);
+    if (present) {
+        grid->editCells[cell / 4] |= bits << (2 * (cell % 4));
+    } else {
+        grid->editCells[cell / 4] &= ~(bits << (2 * (cell % 4)));
+    }
+}
+
+void MazeGrid_Generate(maze_grid_t *grid, uint32_t seed) {
+    uint32_t random = (seed != 0) ? seed : 1;
+    uint32_t i;
+    uint16_t x, y, huntRow = 0;
+    uint8_t side;
+    
+    // Start with every wall up, a cell is visited once a side is opened
+    for (i = 0; i < MAZE_GRID_BYTES(grid->width, grid->height); i++) {
+        grid->editCells[i] = 0xFF;
+    }
+    x = NextRandom(&random) % grid->width;
+    y = NextRandom(&random) % grid->height;
+    
+    while (1) {
+        // Walk into unvisited cells until there are none next to the walk
+        while ((side = PickNeighbour(grid, x, y, 1, &random)) != 0) {
+            MazeGrid_SetWalls(grid, x, y, side, 0);
+            x += (side == MazeWallPosX) - (side == MazeWallNegX);
+            y += (side == MazeWallPosY) - (side == MazeWallNegY);
+        }
+        
+        // Hunt for an unvisited cell next to a visited one and join them,
+        // rows before huntRow have no unvisited cells left
+        side = 0;
+        for (y = huntRow; (y < grid->height) && (side == 0); y++) {
+            uint8_t rowDone = 1;
+            for (x = 0; x < grid->width; x++) {
+                if (!Unvisited(grid, x, y)) {
+                    continue;
+                }
+                rowDone = 0;
+                if ((side = PickNeighbour(grid, x, y, 0, &random)) != 0) {
+                    break;
+                }
+            }
+            if (rowDone && (y == huntRow)) {
+                huntRow++;
+            }
+        }
+        if (side == 0) {
+            return;
+        }
+        y--;
+        MazeGrid_SetWalls(grid, x, y, side, 0);
+    }
+}
+
+uint8_t MazeGrid_Walls(const maze_grid_t *grid, uint16_t x, uint16_t y) {
+    uint32_t cell = x + ((uint32_t) y * grid->width);
+    uint8_t bits = grid->cells[cell / 4] >> (2 * (cell % 4));
+    uint8_t walls = 0;
+    
+    walls |= ((bits & 1) || (x + 1 == grid->width)) ? MazeWallPosX : 0;
+    walls |= ((bits & 2) || (y + 1 == grid->height)) ? MazeWallPosY : 0;
+    if (x == 0) {
+        walls |= MazeWallNegX;
+    } else {
+        cell--;
+        walls |= ((grid->cells[cell / 4] >> (2 * (cell % 4))) & 1) ? MazeWallNegX : 0;
+    }
+    if (y == 0) {
+        walls |= MazeWallNegY;
+    } else {
+        cell = x + ((uint32_t) (y - 1) * grid->width);
+        walls |= ((grid->cells[cell / 4] >> (2 * (cell % 4))) & 2) ? MazeWallNegY : 0;
+    }
+    return walls;
+}
+
+void MazeWorld_StartPose(maze_pose_t *pose) {
+    pose->x = ((int32_t) worldGrid->startX - worldGrid->exitX) * TILE_SIZE *
+            MAZE_POSE_SCALE;
+    pose->y = ((int32_t) worldGrid->startY - worldGrid->exitY) * TILE_SIZE *
+            MAZE_POSE_SCALE;
+    pose->yaw = 90 / CAMERA_ROTATE;
+}
+
+void MazeWorld_Move(maze_pose_t *pose, int8_t forward, int8_t left) {
+    const int32_t cellSize = TILE_SIZE * MAZE_POSE_SCALE;
+    int8_t dx = moveX[pose->yaw];
+    int8_t dy = moveY[pose->yaw];
+    
+    // Moving left is a move forward rotated by 90 degrees
+    int32_t stepX = (forward * dx) - (left * dy);
+    int32_t stepY = (forward * dy) + (left * dx);
+    int32_t gridX = pose->x + (cellSize / 2) + (worldGrid->exitX * cellSize);
+    int32_t gridY = pose->y + (cellSize / 2) + (worldGrid->exitY * cellSize);
+    
+    // Each axis is dropped on its own when it would run into a wall, so the
+    // camera slides along walls it walks into at an angle. Whole steps are
+    // dropped rather than cut short to keep the pose on the lattice
+    if (!Blocked(gridX + stepX, gridY)) {
+        pose->x += stepX;
+        gridX += stepX;
+    }
+    if (!Blocked(gridX, gridY + stepY)) {
+        pose->y += stepY;
+    }
+}
+
+void MazeWorld_Rotate(maze_pose_t *pose, int8_t steps) {
+    pose->yaw = (pose->yaw + MAZE_POSE_YAW_STEPS + steps) % MAZE_POSE_YAW_STEPS;
+}
+
+void MazeWorld_ApplyMove(maze_pose_t *pose, uint8_t move) {
+    switch (move) {
+        case MazeForward:
+            MazeWorld_Move(pose, 1, 0);
+            break;
+        case MazeBackward:
+            MazeWorld_Move(pose, -1, 0);
+            break;
+        case MazeLeft:
+            MazeWorld_Move(pose, 0, 1);
+            break;
+        case MazeRight:
+            MazeWorld_Move(pose, 0, -1);
+            break;
+        case MazeTurnLeft:
+            MazeWorld_Rotate(pose, 1);
+            break;
+        case MazeTurnRight:
+            MazeWorld_Rotate(pose, -1);
+            break;
+        default:
+            break;
+    }
+}
+
+void MazeWorld_SetCamera(maze_pose_t *pose, camera_t *camera) {
+    camera->fovHorizontal = CAMERA_FOV_HORIZONTAL;
+    camera->fovVertical = CAMERA_FOV_VERTICAL;
+    camera->location.x = (float) pose->x / MAZE_POSE_SCALE;
+    camera->location.y = (float) pose->y / MAZE_POSE_SCALE;
+    camera->location.z = CAMERA_HEIGHT;
+    camera->rotation.x = 0;
+    camera->rotation.y = 0;
+    camera->rotation.z = pose->yaw * CAMERA_ROTATE;
+    camera->farDistance = MAZE_FAR_DISTANCE;
+    camera->fogDistance = (MAZE_FOG_BAND > 0) ? MAZE_FAR_DISTANCE - MAZE_FOG_BAND : 0;
+    camera->fogColor = FOG_COLOR;
+}
+
+static void AddTile(maze_grid_t *grid, int x, int y,
+        uint8_t posXWall, uint8_t negXWall, uint8_t posYWall, uint8_t negYWall) {
+    MazeGrid_SetWalls(grid, x + grid->exitX, y + grid->exitY,
+            (posXWall ? MazeWallPosX : 0) | (negXWall ? MazeWallNegX : 0) |
+            (posYWall ? MazeWallPosY : 0) | (negYWall ? MazeWallNegY : 0), 1);
+}
+
+static uint32_t AddInstance(render_instance_t *instances, uint32_t index,
+        const maze_grid_t *grid, uint16_t x, uint16_t y, uint8_t mesh) {
+    instances[index].offset.x = ((int32_t) x - grid->exitX) * TILE_SIZE;
+    instances[index].offset.y = ((int32_t) y - grid->exitY) * TILE_SIZE;
+    instances[index].offset.z = 0;
+    instances[index].mesh = mesh;
+    instances[index].color = 0;
+    
+    if ((mesh == MazeMeshBase) && (x == grid->exitX) && (y == grid->exitY)) {
+        instances[index].color = WIN_TILE;
+    }
+    
+    return 1;
+}
+
+static uint32_t AddWall(triangle_t *triangles, uint32_t index, vector_t from,
+        vector_t to, uint8_t color) {
+    vector_t fromTop = {from.x, from.y, WALL_HEIGHT};
+    vector_t toTop = {to.x, to.y, WALL_HEIGHT};
+    
+    // Same corner order as the wall meshes, from is the low end
+    triangles[index].p1 = to;
+    triangles[index].p2 = toTop;
+    triangles[index].p3 = from;
+    triangles[index].color = color;
+    triangles[index + 1].p1 = toTop;
+    triangles[index + 1].p2 = fromTop;
+    triangles[index + 1].p3 = from;
+    triangles[index + 1].color = color;
+    return 2;
+}
+
+static void SetWorld(world_t *world, const maze_grid_t *grid) {
+    Render_Engine_InitWorld(world);
+    world->backgroundColor = WORLD_BACKGROUND;
+    world->gridScale = GRID_SCALE;
+    worldGrid = grid;
+}
+
+static void SetMoves(void) {
+    // Precompute the lattice step of a move for every camera rotation
+    uint16_t yaw;
+    for (yaw = 0; yaw < MAZE_POSE_YAW_STEPS; yaw++) {
+        moveX[yaw] = lround(CAMERA_MOVE * MAZE_POSE_SCALE *
+                cos(yaw * CAMERA_ROTATE * (3.14159 / 180.0)));
+        moveY[yaw] = lround(CAMERA_MOVE * MAZE_POSE_SCALE *
+                sin(yaw * CAMERA_ROTATE * (3.14159 / 180.0)));
+    }
+}
+
+static uint8_t Blocked(int32_t gridX, int32_t gridY) {
+    const int32_t cellSize = TILE_SIZE * MAZE_POSE_SCALE;
+    const int32_t radius = PLAYER_RADIUS * MAZE_POSE_SCALE;
+    int32_t low, high, line, cell, last;
+    
+    // The camera is a square of twice the radius. It is smaller than a cell, so
+    // it crosses at most one grid line each way and touches at most four cells
+    if ((gridX - radius < 0) || (gridY - radius < 0) ||
+            (gridX + radius > worldGrid->width * cellSize) ||
+            (gridY + radius > worldGrid->height * cellSize)) {
+        return 1;
+    }
+    
+    // Walls along y on the line between columns crossed by the square
+    low = gridX - radius;
+    high = gridX + radius;
+    line = (low / cellSize) + 1;
+    if (line * cellSize < high) {
+        last = (gridY + radius - 1) / cellSize;
+        for (cell = (gridY - radius) / cellSize; cell <= last; cell++) {
+            if (MazeGrid_Walls(worldGrid, line - 1, cell) & MazeWallPosX) {
+                return 1;
+            }
+        }
+    }
+    
+    // Walls along x on the line between rows crossed by the square
+    low = gridY - radius;
+    high = gridY + radius;
+    line = (low / cellSize) + 1;
+    if (line * cellSize < high) {
+        last = (gridX + radius - 1) / cellSize;
+        for (cell = (gridX - radius) / cellSize; cell <= last; cell++) {
+            if (MazeGrid_Walls(worldGrid, cell, line - 1) & MazeWallPosY) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint8_t Unvisited(const maze_grid_t *grid, uint16_t x, uint16_t y) {
+    return MazeGrid_Walls(grid, x, y) == (MazeWallPosX | MazeWallNegX |
+            MazeWallPosY | MazeWallNegY);
+}
+
+static uint8_t PickNeighbour(const maze_grid_t *grid, uint16_t x, uint16_t y,
+        uint8_t unvisited, uint32_t *random) {
+    uint8_t sides[4];
+    uint8_t count = 0;
+    
+    // Neighbours inside the grid that are (or are not) still unvisited
+    if ((x + 1 < grid->width) && (Unvisited(grid, x + 1, y) == unvisited)) {
+        sides[count++] = MazeWallPosX;
+    }
+    if ((x > 0) && (Unvisited(grid, x - 1, y) == unvisited)) {
+        sides[count++] = MazeWallNegX;
+    }
+    if ((y + 1 < grid->height) && (Unvisited(grid, x, y + 1) == unvisited)) {
+        sides[count++] = MazeWallPosY;
+    }
+    if ((y > 0) && (Unvisited(grid, x, y - 1) == unvisited)) {
+        sides[count++] = MazeWallNegY;
+    }
+    
+    return (count == 0) ? 0 : sides[NextRandom(random) % count];
+}
+
+static uint32_t NextRandom(uint32_t *state) {
+    // xorshift32, small and the same on every platform
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
@@ -0,0 +1,311 @@
+/**
+ * @defgroup maze_world Maze World
+ * @ingroup maze_game
+ * @file maze_world.h
+ * @version 1
+ * 
+ * Created on October 16, 2026
+ * 
+ * Layout of the maze and the rules for moving the player's camera through it.
+ * This is kept apart from the game so host tools can build the same world and
+ * walk the same camera poses without the game system or a UART.
+ * 
+ * The maze itself is a grid of cells with two wall bits each (maze_grid_t).
+ * The triangles of the world and every question about the layout, like which
+ * walls surround a cell or whether the camera reached the exit, come from the
+ * grid. A maze drawn as an ASCII map can be compiled ahead of time into a const
+ * maze_level_t by tools/maze_compile.c and loaded with MazeWorld_LoadLevel().
+ * 
+ * Camera poses live on a lattice. Locations are stored in 1/MAZE_POSE_SCALE
+ * world units and rotations in whole turn steps, so moving back and forth
+ * in open space always returns to exactly the same pose. Moves collide with
+ * the walls of the grid and slide along them. Poses are 16 bits, so every cell
+ * must be at most MAZE_POSE_MAX_CELLS cells away from the exit.
+ * 
+ * @{
+ */
+
+#ifndef MAZE_WORLD_H
+#define MAZE_WORLD_H
+
+#include <stdint.h>
+#include "render_engine.h"
+
+#define MAZE_NUM_TRIANGLES 120 ///< triangles in the world built by MazeWorld_Build()
+#define MAZE_NUM_INSTANCES 60 ///< instances needed by MazeWorld_Build()
+
+// Bytes of cells a grid of the given size needs
+#define MAZE_GRID_BYTES(width, height) ((((uint32_t) (width) * (height)) + 3) / 4)
+
+// Most instances MazeWorld_Load() can place for a grid of the given size
+#define MAZE_GRID_INSTANCES(width, height) \
+        (((uint32_t) (width) * (height)) + (((uint32_t) (width) + 1) * (height)) + \
+        ((uint32_t) (width) * ((height) + 1)))
+
+/// Sides of a cell, combined into the masks used by the grid functions
+enum maze_wall {
+    MazeWallPosX = 1,
+    MazeWallNegX = 2,
+    MazeWallPosY = 4,
+    MazeWallNegY = 8
+};
+#define MAZE_CELL_SIZE 4 ///< world units along each side of a cell
+#define MAZE_POSE_SCALE 16 ///< lattice points per world unit
+#define MAZE_POSE_YAW_STEPS 24 ///< turn steps in a full rotation
+
+// Farthest a cell can be from the exit along each axis with every pose inside
+// it still fitting in the 16 bits of maze_pose_t
+#define MAZE_POSE_MAX_CELLS ((INT16_MAX - (MAZE_CELL_SIZE * MAZE_POSE_SCALE / 2)) / \
+        (MAZE_CELL_SIZE * MAZE_POSE_SCALE))
+
+/// Ways the player can change the pose with one keypress
+enum maze_move {
+    MazeForward,
+    MazeBackward,
+    MazeLeft,
+    MazeRight,
+    MazeTurnLeft,
+    MazeTurnRight,
+    MAZE_NUM_MOVES
+};
+
+typedef struct maze_pose {
+    int16_t x; ///< camera x location in lattice units
+    int16_t y; ///< camera y location in lattice units
+    uint16_t yaw; ///< camera rotation in turn steps
+} maze_pose_t;
+
+/**
+ * Layout of a maze. Each cell has two bits, a wall on its positive x side and
+ * one on its positive y side, four cells to a byte in rows of width cells. The
+ * negative sides of a cell are the positive sides of its neighbours and the
+ * edge of the grid is always a wall, so a 256 by 256 maze fits in 16 KB.
+ * Reading only goes through cells, so the bytes of a compiled level stay const.
+ */
+typedef struct maze_grid {
+    const uint8_t *cells; ///< MAZE_GRID_BYTES(width, height) bytes
+    uint8_t *editCells; ///< the same bytes when they can be changed, 0 if const
+    uint16_t width;
+    uint16_t height;
+    uint16_t exitX; ///< cell the player has to reach, placed at the origin
+    uint16_t exitY;
+    uint16_t startX; ///< cell the player starts in, facing positive y
+    uint16_t startY;
+} maze_grid_t;
+
+/**
+ * Maze compiled ahead of time from an ASCII map by tools/maze_compile.c. All of
+ * it is const, so the whole world can stay in flash: the instances are the
+ * ones MazeWorld_Load() would place, with their first triangles numbered.
+ */
+typedef struct maze_level {
+    maze_grid_t grid; ///< layout, editCells is 0 as the cells are const
+    const render_instance_t *instances; ///< tiles of the world
+    uint32_t numInstances;
+    uint32_t numTriangles;
+} maze_level_t;
+
+/** @brief Set up an empty grid
+ * 
+ * The player starts in the exit column on the first row, change startX and
+ * startY to start somewhere else.
+ * 
+ * @param grid Grid to set up.
+ * @param cells Block of MAZE_GRID_BYTES(width, height) bytes.
+ * @param width Cells along x.
+ * @param height Cells along y.
+ * @param exitX Column of the exit cell.
+ * @param exitY Row of the exit cell.
+ */
+void MazeGrid_Init(maze_grid_t *grid, uint8_t *cells, uint16_t width,
+        uint16_t height, uint16_t exitX, uint16_t exitY);
+
+/** @brief Add or remove walls around a cell
+ * 
+ * Walls on the negative sides are changed on the neighbouring cells. The edge
+ * of the grid is always a wall and cannot be removed.
+ * 
+ * @param grid Grid set up with MazeGrid_Init().
+ * @param x Column of the cell.
+ * @param y Row of the cell.
+ * @param walls Mask of maze_wall sides to change.
+ * @param present 1 to add the walls, 0 to remove them.
+ */
+void MazeGrid_SetWalls(maze_grid_t *grid, uint16_t x, uint16_t y, uint8_t walls,
+        uint8_t present);
+
+/** @brief Carve a random maze into a grid
+ * 
+ * Walls off every cell, then opens a single path between any two cells with
+ * the hunt and kill algorithm: a random walk carves through unvisited cells
+ * until it gets stuck, then a scan for an unvisited cell next to the visited
+ * part starts the next walk. Visited cells are the ones with an open side, so
+ * no memory is needed besides the grid.
+ * 
+ * @param grid Grid set up with MazeGrid_Init(), keeps its exit and start.
+ * @param seed Same seed, same maze.
+ */
+void MazeGrid_Generate(maze_grid_t *grid, uint32_t seed);
+
+/** @brief Get the walls around a cell
+ * 
+ * @param grid Grid to read.
+ * @param x Column of the cell.
+ * @param y Row of the cell.
+ * @return Mask of maze_wall sides that have a wall.
+ */
+uint8_t MazeGrid_Walls(const maze_grid_t *grid, uint16_t x, uint16_t y);
+
+/** @brief Build the maze
+ * 
+ * Fills the grid of the maze and loads it into the world with
+ * MazeWorld_Load(). This must be called before any of the pose functions are
+ * used.
+ * 
+ * @param world World to set up.
+ * @param instances Array of at least MAZE_NUM_INSTANCES instances.
+ * @return Number of triangles in the world.
+ */
+uint16_t MazeWorld_Build(world_t *world, render_instance_t *instances);
+
+/** @brief Turn a grid into a world
+ * 
+ * Fills the instance array with a base for every cell and every wall of the
+ * grid and points the world at it, the meshes they place are kept in flash.
+ * The grid becomes the one the pose functions use and must stay valid.
+ * 
+ * @param world World to set up.
+ * @param grid Layout of the maze.
+ * @param instances Array of at least MAZE_GRID_INSTANCES(grid->width,
+ * grid->height) instances.
+ * @return Number of triangles in the world.
+ */
+uint32_t MazeWorld_Load(world_t *world, const maze_grid_t *grid,
+        render_instance_t *instances);
+
+/** @brief Place the instances of a block of cells
+ * 
+ * Places the same instances MazeWorld_Load() does for these cells, so the
+ * blocks of a grid together make up its whole world.
+ * 
+ * @param grid Layout of the maze.
+ * @param left Column of the first cell of the block.
+ * @param bottom Row of the first cell of the block.
+ * @param width Cells of the block along x.
+ * @param height Cells of the block along y.
+ * @param instances Array of at least MAZE_GRID_INSTANCES(width, height)
+ * instances.
+ * @return Number of instances placed.
+ */
+uint32_t MazeWorld_PlaceCells(const maze_grid_t *grid, uint16_t left,
+        uint16_t bottom, uint16_t width, uint16_t height,
+        render_instance_t *instances);
+
+/** @brief Point a world at placed instances
+ * 
+ * Loads instances from MazeWorld_PlaceCells() into the world and makes the
+ * grid the one the pose functions use. Call it again whenever instances are
+ * added or removed.
+ * 
+ * @param world World to set up.
+ * @param grid Layout of the maze, must stay valid.
+ * @param instances Instances placed from the grid.
+ * @param numInstances Number of instances.
+ * @return Number of triangles in the world.
+ */
+uint32_t MazeWorld_LoadPlaced(world_t *world, const maze_grid_t *grid,
+        render_instance_t *instances, uint32_t numInstances);
+
+/** @brief Point a world at a compiled maze
+ * 
+ * Nothing is copied or generated, the world renders straight from the level.
+ * This can be called instead of MazeWorld_Build().
+ * 
+ * @param world World to set up.
+ * @param level Maze written by tools/maze_compile.c.
+ * @return Number of triangles in the world.
+ */
+uint32_t MazeWorld_LoadLevel(world_t *world, const maze_level_t *level);
+
+/** @brief Turn a grid into a world with merged walls
+ * 
+ * Like MazeWorld_Load(), but straight runs of walls become one long wall of
+ * two triangles. The world holds far fewer triangles, at the cost of the
+ * painting order: long walls are sorted by their middle, so a wall that passes
+ * close to the camera can be painted over a nearer one. Good for large mazes
+ * seen from afar and for counting, the game uses MazeWorld_Load().
+ * 
+ * @param world World to set up.
+ * @param grid Layout of the maze.
+ * @param triangles Array of at least 2 * MAZE_GRID_INSTANCES(grid->width,
+ * grid->height) triangles.
+ * @return Number of triangles in the world.
+ */
+uint32_t MazeWorld_LoadMerged(world_t *world, const maze_grid_t *grid,
+        triangle_t *triangles);
+
+/** @brief Get the grid of the world
+ * 
+ * @return Grid of the last world loaded.
+ */
+const maze_grid_t *MazeWorld_Grid(void);
+
+/** @brief Find the cell the camera stands in
+ * 
+ * @param pose Pose of the player.
+ * @param x Set to the column of the cell.
+ * @param y Set to the row of the cell.
+ * @return 1 if the camera is inside a cell of the grid, 0 if it is outside the
+ * grid or exactly on the edge between cells.
+ */
+uint8_t MazeWorld_PoseCell(maze_pose_t *pose, uint16_t *x, uint16_t *y);
+
+/** @brief Check if the camera reached the exit
+ * 
+ * @param pose Pose of the player.
+ * @return 1 if the camera is inside the exit cell.
+ */
+uint8_t MazeWorld_AtExit(maze_pose_t *pose);
+
+/** @brief Get the pose the player starts at
+ * 
+ * @param pose Pose to set.
+ */
+void MazeWorld_StartPose(maze_pose_t *pose);
+
+/** @brief Move the camera one step
+ * 
+ * The step is checked against the walls of the grid around the camera only, so
+ * it costs the same however large the world is. A step into a wall keeps the
+ * part along the wall, and the camera never comes closer to a wall than a
+ * quarter of a cell.
+ * 
+ * @param pose Pose to move.
+ * @param forward 1 to move forward, -1 to move backward.
+ * @param left 1 to move left, -1 to move right.
+ */
+void MazeWorld_Move(maze_pose_t *pose, int8_t forward, int8_t left);
+
+/** @brief Turn the camera
+ * 
+ * @param pose Pose to turn.
+ * @param steps Number of turn steps, positive turns left.
+ */
+void MazeWorld_Rotate(maze_pose_t *pose, int8_t steps);
+
+/** @brief Apply one keypress worth of movement
+ * 
+ * @param pose Pose to change.
+ * @param move One of the maze_move values.
+ */
+void MazeWorld_ApplyMove(maze_pose_t *pose, uint8_t move);
+
+/** @brief Set up a camera to look from a pose
+ * 
+ * @param pose Pose of the player.
+ * @param camera Camera to set the field of view, location and rotation of.
+ */
+void MazeWorld_SetCamera(maze_pose_t *pose, camera_t *camera);
+
+/** @} */
+#endif // MAZE_WORLD_H
@@ -1,36 +1,200 @@
 #include "render_engine.h"
+#include <float.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#ifndef RENDER_ENGINE_HOST
 #include "subsystem.h"
 #include "uart.h"
 #include "terminal.h"
+#endif
+
+// Pick the widest vector unit the compiler targets for batches of corners
+#if defined(RENDER_ENGINE_NO_SIMD)
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define RENDER_SIMD_AVX
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RENDER_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RENDER_SIMD_NEON
+#endif
+
+// A corner must land on the same pixel whether it is projected on its own,
+// in a batch or from a scene, so a multiply and an add are never fused into
+// one FMA instruction with a different rounding. GCC fuses them by default
+// when the target has FMA, like -march=native on x86 or any AArch64 build
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(RENDER_ENGINE_FIXED_WIDTH) != defined(RENDER_ENGINE_FIXED_HEIGHT)
+#error "RENDER_ENGINE_FIXED_WIDTH and RENDER_ENGINE_FIXED_HEIGHT go together"
+#endif
 
 #define M_PI 3.14159265358979323846
 
+// Columns and rows copied together by Render_Engine_TransposeFrame()
+#define RENDER_TRANSPOSE_BLOCK 16
+
+// Pixels of margin kept when a scene leaves out triangles past the sides of
+// the view, covers any rounding of the angles
+#define RENDER_SCENE_MARGIN 2
+
+// Triangle index given to projectTriangle() for the triangles of objects,
+// their corners are never in the vertex store or scene
+#define RENDER_OBJECT_INDEX UINT32_MAX
+
+// Object triangles in an order are numbered by slot and triangle of the mesh
+#define RENDER_OBJECT_SHIFT 16
+
+// Corner of a triangle while Render_Engine_LoadScene() looks for shared ones
+typedef struct render_scene_corner {
+    vector_t point;
+    uint32_t corner; ///< 3 * triangle + corner of the triangle
+} render_scene_corner_t;
+
+// Square root used by the projection
+#ifdef RENDER_ENGINE_FAST_MATH
+#define engineSqrt(value) Render_Engine_FastSqrt(value)
+#else
+#define engineSqrt(value) sqrt(value)
+#endif
+
 // Rendering helper functions
-point_t pointToScreen(vector_t delta,
-        rounding_t camHAngle, rounding_t camVAngle,
-        rounding_t angleHPixel, rounding_t angleVPixel,
-        uint8_t halfWidth, uint8_t halfHeight);
+triangle_t *worldTriangle(world_t *world, uint32_t index, triangle_t *instanced);
+triangle_t *objectTriangle(world_t *world, uint32_t index, triangle_t *instanced);
+void placeTriangle(world_t *world, const render_mesh_t *meshes,
+        const render_instance_t *instance, uint32_t index, triangle_t *instanced);
+triangle_t *nextTriangle(render_context_t *context, triangle_t *instanced,
+        uint32_t *index, uint8_t *fog);
+void unpackCorner(const int8_t *packed, rounding_t scale, vector_t *corner);
+#ifdef RENDER_ENGINE_THREADS
+void *renderWorker(void *pool);
+void paintTiles(render_pool_t *pool);
+void freePool(render_pool_t *pool);
+uint16_t screenToTile(rounding_t a, rounding_t b, rounding_t c,
+        uint16_t size, uint16_t tileSize, uint8_t last);
+void *jobWorker(void *worker);
+render_job_t *takeJob(render_worker_t *worker);
+#endif
+uint8_t projectTriangle(render_context_t *context, uint32_t index,
+        triangle_t *triangle, point_t *p1, point_t *p2, point_t *p3);
+void rasterTriangle(render_context_t *context,
+        point_t p1, point_t p2, point_t p3, uint8_t color);
+uint32_t orderScene(render_context_t *context, render_order_t *order);
+uint32_t orderObjects(render_context_t *context, render_order_t *order);
+uint32_t countFog(render_order_t *order, uint32_t count, rounding_t fogDistance);
+void projectScene(render_context_t *context, point_t *screen, uint8_t *needed);
+uint32_t transformVertices(render_context_t *context, render_vertices_t *vertices,
+        uint32_t first, rounding_t *dx, rounding_t *dy, rounding_t *dz,
+        double *horizontal);
+point_t pointToScreen(render_context_t *context, vector_t delta, double horizontal);
 rounding_t dotProduct(vector_t a, vector_t b);
-static camera_t compareCamera;
+vector_t triangleCenter(triangle_t *triangle);
+rounding_t distanceToPoint(vector_t point, vector_t location);
+rounding_t distanceToTriangle(triangle_t *triangle, vector_t location);
 int compareTriangles(const void *a, const void *b);
-void paintPixel(framebuffer_t *frame, uint16_t x, uint16_t y, uint8_t color);
-void paintPixelf(framebuffer_t *frame, rounding_t x, rounding_t y, uint8_t color);
+int compareCorners(const void *a, const void *b);
+uint32_t encodeNumber(uint8_t *out, uint32_t number);
+
+// Painting helper functions, always inlined so the copy of the rasterizer for
+// a constant area folds it into the pixel loops
+#define RENDER_INLINE static inline __attribute__((always_inline))
+RENDER_INLINE void rasterArea(render_area_t area,
+        point_t p1, point_t p2, point_t p3, uint8_t color);
+RENDER_INLINE void paintColumn(render_area_t area, rounding_t x,
+        rounding_t topY, rounding_t bottomY, uint8_t color);
+RENDER_INLINE void paintPixel(render_area_t area, uint16_t x, uint16_t y, uint8_t color);
+RENDER_INLINE void paintPixelf(render_area_t area, rounding_t x, rounding_t y, uint8_t color);
 
+#ifndef RENDER_ENGINE_HOST
 // UART helper functions
-void changeTerminalCursorLocation(uint8_t channel, uint8_t x, uint8_t y);
-void writeTerminalNumber(uint8_t channel, uint8_t number);
+void changeTerminalCursorLocation(uint8_t channel, uint16_t x, uint16_t y);
+void writeTerminalNumber(uint8_t channel, uint32_t number);
 void changeTerminalColor(uint8_t channel, uint8_t color);
 void writeTerminalBlock(uint8_t channel, uint8_t data);
+RENDER_INLINE void writeTerminalFrame(uint8_t channel, uint8_t *buffer,
+        uint16_t width, uint16_t height, uint16_t columnStep, uint16_t rowStep);
+#endif
+
+void Render_Engine_InitWorld(world_t *world) {
+    world->backgroundColor = 0;
+    world->numTriangles = 0;
+    world->triangles = 0;
+    world->vertices = 0;
+    world->scene = 0;
+    world->meshes = 0;
+    world->instances = 0;
+    world->numInstances = 0;
+    world->gridScale = 0;
+    world->objects = 0;
+}
+
+void Render_Engine_InitCamera(camera_t *camera) {
+    camera->status = 0;
+    camera->location.x = 0;
+    camera->location.y = 0;
+    camera->location.z = 0;
+    camera->rotation.x = 0;
+    camera->rotation.y = 0;
+    camera->rotation.z = 0;
+    camera->fovHorizontal = 0;
+    camera->fovVertical = 0;
+    camera->farDistance = 0;
+    camera->fogDistance = 0;
+    camera->fogColor = 0;
+}
 
 void Render_Engine_RenderFrame(world_t *world, camera_t *camera, framebuffer_t *frame) {
-    uint16_t bufLength = frame->width * frame->height;
-    uint8_t halfWidth = frame->width / 2;
-    uint8_t halfHeight = frame->height / 2;
-    rounding_t anglePerPixelHorizontal = (camera->fovHorizontal * M_PI) /
+    render_context_t context;
+    render_order_t order[RENDER_ORDER_SIZE(world)];
+    
+    Render_Engine_BeginFrame(&context, world, camera, frame, order);
+    if (world->scene != 0) {
+        point_t screen[world->scene->vertices.stride];
+        uint8_t needed[world->scene->vertices.count];
+        Render_Engine_ProjectVertices(&context, screen, needed);
+        Render_Engine_FinishFrame(&context);
+    } else if (world->vertices != 0) {
+        point_t screen[world->vertices->stride];
+        uint8_t visible[world->numTriangles];
+        Render_Engine_ProjectVertices(&context, screen, visible);
+        Render_Engine_FinishFrame(&context);
+    } else {
+        Render_Engine_FinishFrame(&context);
+    }
+}
+
+void Render_Engine_BeginFrame(render_context_t *context, world_t *world,
+        camera_t *camera, framebuffer_t *frame, render_order_t *order) {
+    uint32_t bufLength = (uint32_t) frame->width * frame->height;
+    rounding_t farDistance = camera->farDistance * camera->farDistance;
+    rounding_t fogDistance = camera->fogDistance * camera->fogDistance;
+    uint32_t i;
+    
+    context->world = world;
+    context->camera = *camera;
+    context->frame = frame;
+    context->order = order;
+    context->next = 0;
+    context->screen = 0;
+    context->visible = 0;
+    context->clipLeft = 0;
+    context->clipTop = 0;
+    context->clipRight = frame->width;
+    context->clipBottom = frame->height;
+    
+    // Work out the view once for the whole frame
+    context->halfWidth = frame->width / 2;
+    context->halfHeight = frame->height / 2;
+    context->anglePerPixelHorizontal = (camera->fovHorizontal * M_PI) /
             (frame->width * 180.0);
-    rounding_t anglePerPixelVertical = (camera->fovVertical * M_PI) /
+    context->anglePerPixelVertical = (camera->fovVertical * M_PI) /
             (frame->height * 180.0);
     rounding_t cameraHorizontalAngle = camera->rotation.z;
     if (camera->rotation.z < 0) {
@@ -45,288 +209,1425 @@ void Render_Engine_RenderFrame(world_t *world, camera_t *camera, framebuffer_t *
     vector_t cameraDirection = {cos(cameraHorizontalAngle),
             sin(cameraHorizontalAngle),
             ((cameraVerticalAngle <= -90) || (cameraVerticalAngle >= 90)) ? tan(cameraVerticalAngle) : ((cameraVerticalAngle > 0) - (cameraVerticalAngle < 0)) * 10000};
-    uint16_t i;
+    context->cameraHorizontalAngle = cameraHorizontalAngle;
+    context->cameraVerticalAngle = cameraVerticalAngle;
+    context->cameraDirection = cameraDirection;
     
     // Set the framebuffer to the background color
     for (i = 0; i < bufLength; i++) {
         frame->buffer[i] = world->backgroundColor;
     }
     
-    // Sort triangles by distance to the camera
-    triangle_t triangles[world->numTriangles];
-    for (i = 0; i < world->numTriangles; i++) {
-        triangles[i].color = world->triangles[i].color;
-        triangles[i].p1 = world->triangles[i].p1;
-        triangles[i].p2 = world->triangles[i].p2;
-        triangles[i].p3 = world->triangles[i].p3;
+    // Sort triangles by distance to the camera, the distance is calculated
+    // once up front so sorting does not need to know about the camera
+    if (world->scene != 0) {
+        context->orderCount = orderScene(context, order);
+    } else {
+        context->orderCount = 0;
+        for (i = 0; i < world->numTriangles; i++) {
+            triangle_t instanced;
+            rounding_t distance = distanceToTriangle(worldTriangle(world, i, &instanced),
+                    camera->location);
+            if ((camera->farDistance > 0) && (distance > farDistance)) {
+                continue;
+            }
+            order[context->orderCount].distance = distance;
+            order[context->orderCount].index = i;
+            context->orderCount++;
+        }
     }
-    compareCamera.location.x = camera->location.x;
-    compareCamera.location.y = camera->location.y;
-    compareCamera.location.z = camera->location.z;
-    qsort(triangles, world->numTriangles, sizeof(triangle_t), compareTriangles);
+    qsort(order, context->orderCount, sizeof(render_order_t), compareTriangles);
+    context->fogCount = countFog(order, context->orderCount, fogDistance);
     
-    // Go through all triangles
-    vector_t p1Delta, p2Delta, p3Delta;
+    // Objects are sorted on their own after the world, moving them never
+    // changes anything loaded from the world
+    context->objectOrder = order + world->numTriangles;
+    context->objectNext = 0;
+    context->objectCount = 0;
+    if (world->objects != 0) {
+        context->objectCount = orderObjects(context, context->objectOrder);
+        qsort(context->objectOrder, context->objectCount, sizeof(render_order_t),
+                compareTriangles);
+    }
+    context->objectFogCount = countFog(context->objectOrder, context->objectCount,
+            fogDistance);
+}
+
+uint8_t Render_Engine_StepFrame(render_context_t *context, uint32_t numTriangles) {
+    triangle_t instanced;
+    triangle_t *triangle;
     point_t p1, p2, p3;
-    uint8_t leftSel, rightSel;
-    point_t left, right, center;
-    for (i = 0; i < world->numTriangles; i++) {
-        // Calculate the difference between point location and camera
-        p1Delta.x = triangles[i].p1.x - camera->location.x;
-        p1Delta.y = triangles[i].p1.y - camera->location.y;
-        p1Delta.z = triangles[i].p1.z - camera->location.z;
-        p2Delta.x = triangles[i].p2.x - camera->location.x;
-        p2Delta.y = triangles[i].p2.y - camera->location.y;
-        p2Delta.z = triangles[i].p2.z - camera->location.z;
-        p3Delta.x = triangles[i].p3.x - camera->location.x;
-        p3Delta.y = triangles[i].p3.y - camera->location.y;
-        p3Delta.z = triangles[i].p3.z - camera->location.z;
-        
-        // Make sure at least one point is in front of the camera
-        if ((dotProduct(p1Delta, cameraDirection) <= 0) &&
-                (dotProduct(p2Delta, cameraDirection) <= 0) &&
-                (dotProduct(p3Delta, cameraDirection) <= 0)) {
-            continue;
+    uint32_t index;
+    uint8_t fog;
+    
+    // Paint the next few triangles, farthest first
+    while ((numTriangles > 0) &&
+            ((triangle = nextTriangle(context, &instanced, &index, &fog)) != 0)) {
+        if (projectTriangle(context, index, triangle, &p1, &p2, &p3)) {
+            rasterTriangle(context, p1, p2, p3,
+                    fog ? context->camera.fogColor : triangle->color);
         }
-        
-        // Calculate the screen coordinates
-        p1 = pointToScreen(p1Delta,
-                cameraHorizontalAngle, cameraVerticalAngle,
-                anglePerPixelHorizontal, anglePerPixelVertical,
-                halfWidth, halfHeight);
-        p2 = pointToScreen(p2Delta,
-                cameraHorizontalAngle, cameraVerticalAngle,
-                anglePerPixelHorizontal, anglePerPixelVertical,
-                halfWidth, halfHeight);
-        p3 = pointToScreen(p3Delta,
-                cameraHorizontalAngle, cameraVerticalAngle,
-                anglePerPixelHorizontal, anglePerPixelVertical,
-                halfWidth, halfHeight);
-        
-        // Determine the left point of the triangle
-        left = p1;
-        leftSel = 1;
-        if (left.x > p2.x) {
-            left = p2;
-            leftSel = 2;
+        numTriangles--;
+    }
+    
+    return (context->next >= context->orderCount) &&
+            (context->objectNext >= context->objectCount);
+}
+
+void Render_Engine_FinishFrame(render_context_t *context) {
+    while (!Render_Engine_StepFrame(context, UINT32_MAX));
+}
+
+void Render_Engine_LoadInstances(world_t *world, const render_mesh_t *meshes,
+        render_instance_t *instances, uint32_t numInstances) {
+    uint32_t i;
+    
+    // Triangles of each instance follow those of the one before
+    world->numTriangles = 0;
+    for (i = 0; i < numInstances; i++) {
+        instances[i].first = world->numTriangles;
+        world->numTriangles += meshes[instances[i].mesh].numTriangles;
+    }
+    world->triangles = 0;
+    world->meshes = meshes;
+    world->instances = instances;
+    world->numInstances = numInstances;
+}
+
+void Render_Engine_ObjectPoolInit(world_t *world, render_object_pool_t *pool,
+        const render_mesh_t *meshes, render_instance_t *objects,
+        uint16_t maxObjects, uint16_t maxTriangles) {
+    uint16_t i;
+    
+    pool->meshes = meshes;
+    pool->objects = objects;
+    pool->maxObjects = maxObjects;
+    pool->numObjects = 0;
+    pool->maxTriangles = maxTriangles;
+    for (i = 0; i < maxObjects; i++) {
+        objects[i].mesh = RENDER_NO_MESH;
+    }
+    world->objects = pool;
+}
+
+render_instance_t *Render_Engine_AddObject(render_object_pool_t *pool, uint16_t mesh,
+        vector_t offset, uint8_t color) {
+    uint16_t i;
+    
+    if ((pool->numObjects == pool->maxObjects) ||
+            (pool->meshes[mesh].numTriangles > pool->maxTriangles)) {
+        return 0;
+    }
+    for (i = 0; pool->objects[i].mesh != RENDER_NO_MESH; i++);
+    pool->objects[i].offset = offset;
+    pool->objects[i].first = 0;
+    pool->objects[i].mesh = mesh;
+    pool->objects[i].color = color;
+    pool->numObjects++;
+    return &pool->objects[i];
+}
+
+void Render_Engine_RemoveObject(render_object_pool_t *pool, render_instance_t *object) {
+    if (object->mesh != RENDER_NO_MESH) {
+        object->mesh = RENDER_NO_MESH;
+        pool->numObjects--;
+    }
+}
+
+void Render_Engine_GetTriangle(world_t *world, uint32_t index, triangle_t *triangle) {
+    *triangle = *worldTriangle(world, index, triangle);
+}
+
+void Render_Engine_LoadVertices(world_t *world, render_vertices_t *vertices,
+        rounding_t *storage) {
+    uint32_t i;
+    
+    vertices->count = world->numTriangles * 3;
+    vertices->stride = RENDER_VERTEX_STRIDE(world->numTriangles);
+    vertices->x = storage;
+    vertices->y = storage + vertices->stride;
+    vertices->z = storage + (2 * vertices->stride);
+    for (i = 0; i < world->numTriangles; i++) {
+        triangle_t instanced;
+        triangle_t *triangle = worldTriangle(world, i, &instanced);
+        vertices->x[3 * i] = triangle->p1.x;
+        vertices->y[3 * i] = triangle->p1.y;
+        vertices->z[3 * i] = triangle->p1.z;
+        vertices->x[(3 * i) + 1] = triangle->p2.x;
+        vertices->y[(3 * i) + 1] = triangle->p2.y;
+        vertices->z[(3 * i) + 1] = triangle->p2.z;
+        vertices->x[(3 * i) + 2] = triangle->p3.x;
+        vertices->y[(3 * i) + 2] = triangle->p3.y;
+        vertices->z[(3 * i) + 2] = triangle->p3.z;
+    }
+    
+    // Pad the last batch so it can be loaded whole
+    for (i = vertices->count; i < vertices->stride; i++) {
+        vertices->x[i] = 0;
+        vertices->y[i] = 0;
+        vertices->z[i] = 0;
+    }
+    
+    world->vertices = vertices;
+}
+
+void Render_Engine_LoadScene(world_t *world, render_scene_t *scene, void *storage) {
+    render_vertices_t *vertices = &scene->vertices;
+    uint32_t numCorners = world->numTriangles * 3;
+    uint32_t stride = RENDER_VERTEX_STRIDE(world->numTriangles);
+    render_scene_corner_t *sorted = storage;
+    uint32_t i, corner;
+    uint8_t k;
+    
+    scene->centers = (vector_t *) ((rounding_t *) storage + (3 * stride));
+    scene->radii = (rounding_t *) (scene->centers + world->numTriangles);
+    scene->corners = (uint32_t *) (scene->radii + world->numTriangles);
+    
+    // Sort a copy of every corner so equal corners end up next to each other,
+    // the copy fits in the space the vertex arrays and middles use later
+    for (i = 0; i < world->numTriangles; i++) {
+        triangle_t instanced;
+        triangle_t *triangle = worldTriangle(world, i, &instanced);
+        vector_t *points[3] = {&triangle->p1, &triangle->p2, &triangle->p3};
+        for (k = 0; k < 3; k++) {
+            sorted[(3 * i) + k].point = *points[k];
+            sorted[(3 * i) + k].corner = (3 * i) + k;
         }
-        if (left.x > p3.x) {
-            left = p3;
-            leftSel = 3;
+    }
+    qsort(sorted, numCorners, sizeof(render_scene_corner_t), compareCorners);
+    
+    // Number the distinct corners, a corner is only shared if it is the same
+    // down to the bit so its projection is too
+    vertices->count = 0;
+    for (i = 0; i < numCorners; i++) {
+        if ((i == 0) || (memcmp(&sorted[i].point, &sorted[i - 1].point,
+                sizeof(vector_t)) != 0)) {
+            vertices->count++;
         }
+        scene->corners[sorted[i].corner] = vertices->count - 1;
+    }
+    
+    // The sorted copy is no longer needed, fill in the vertex arrays
+    vertices->stride = ((vertices->count + RENDER_VERTEX_BATCH - 1) /
+            RENDER_VERTEX_BATCH) * RENDER_VERTEX_BATCH;
+    vertices->x = storage;
+    vertices->y = vertices->x + vertices->stride;
+    vertices->z = vertices->y + vertices->stride;
+    for (i = 0; i < world->numTriangles; i++) {
+        triangle_t instanced;
+        triangle_t *triangle = worldTriangle(world, i, &instanced);
+        vector_t *points[3] = {&triangle->p1, &triangle->p2, &triangle->p3};
+        rounding_t radius = 0;
         
-        // Determine the right point of the triangle
-        right = p3;
-        rightSel = 3;
-        if (((right.x < p2.x) || (leftSel == 3)) && (leftSel != 2)) {
-            right = p2;
-            rightSel = 2;
-        }
-        if ((right.x < p1.x) && (leftSel != 1)) {
-            right = p1;
-            rightSel = 1;
+        scene->centers[i] = triangleCenter(triangle);
+        for (k = 0; k < 3; k++) {
+            corner = scene->corners[(3 * i) + k];
+            vertices->x[corner] = points[k]->x;
+            vertices->y[corner] = points[k]->y;
+            vertices->z[corner] = points[k]->z;
+            radius = fmax(radius, sqrt(distanceToPoint(*points[k],
+                    scene->centers[i])));
         }
         
-        // Determine the center point of the triangle
-        if ((leftSel + rightSel) == 3) {
-            center = p3;
-        } else if ((leftSel + rightSel) == 4) {
-            center = p2;
-        } else if ((leftSel + rightSel) == 5) {
-            center = p1;
+        // A little larger so rounding never leaves a corner outside
+        scene->radii[i] = radius * 1.001f;
+    }
+    
+    // Pad the last batch so it can be loaded whole
+    for (i = vertices->count; i < vertices->stride; i++) {
+        vertices->x[i] = 0;
+        vertices->y[i] = 0;
+        vertices->z[i] = 0;
+    }
+    
+    world->scene = scene;
+}
+
+void Render_Engine_ProjectVertices(render_context_t *context, point_t *screen,
+        uint8_t *visible) {
+    render_vertices_t *vertices = context->world->vertices;
+    rounding_t dx[RENDER_VERTEX_BATCH];
+    rounding_t dy[RENDER_VERTEX_BATCH];
+    rounding_t dz[RENDER_VERTEX_BATCH];
+    double horizontal[RENDER_VERTEX_BATCH];
+    uint32_t front;
+    uint32_t first, triangle;
+    uint8_t i;
+#ifndef RENDER_ENGINE_FAST_MATH
+    uint8_t corner;
+#endif
+    
+    if (context->world->scene != 0) {
+        projectScene(context, screen, visible);
+        return;
+    }
+    
+    for (first = 0; first < vertices->count; first += RENDER_VERTEX_BATCH) {
+        front = transformVertices(context, vertices, first, dx, dy, dz, horizontal);
+        
+#ifdef RENDER_ENGINE_FAST_MATH
+        // Without library calls it is cheaper to project the whole batch in
+        // one loop the compiler can vectorize than to pick out the corners
+        for (i = 0; i < RENDER_VERTEX_BATCH; i++) {
+            vector_t delta = {dx[i], dy[i], dz[i]};
+            screen[first + i] = pointToScreen(context, delta,
+                    Render_Engine_FastSqrt((dx[i] * dx[i]) + (dy[i] * dy[i])));
         }
+#endif
         
-        // Determine the number of triangles to paint
-        if ((left.x == center.x) && (center.x == right.x)) {
-            // One vertical line
-            if ((center.x < 0) || (center.x >= frame->width)) {
-                // Skip rendering if this will not actually be displayed
-                continue;
+        // Only triangles with a corner in front of the camera are projected,
+        // the angles are still worked out one corner at a time
+        for (i = 0; i < RENDER_VERTEX_BATCH; i += 3) {
+            triangle = (first + i) / 3;
+            if (triangle >= context->world->numTriangles) {
+                break;
             }
             
-            rounding_t max = p1.y;
-            if (max < p2.y) {
-                max = p2.y;
+            visible[triangle] = ((front >> i) & 7) != 0;
+#ifndef RENDER_ENGINE_FAST_MATH
+            if (!visible[triangle]) {
+                continue;
             }
-            if (max < p3.y) {
-                max = p3.y;
+            for (corner = i; corner < i + 3; corner++) {
+                vector_t delta = {dx[corner], dy[corner], dz[corner]};
+                screen[first + corner] = pointToScreen(context, delta,
+                        horizontal[corner]);
             }
-            rounding_t min = p1.y;
-            if (min > p2.y) {
-                min = p2.y;
+#endif
+        }
+    }
+    
+    context->screen = screen;
+    context->visible = visible;
+}
+
+#ifdef RENDER_ENGINE_THREADS
+uint8_t Render_Engine_PoolInit(render_pool_t *pool, uint8_t numThreads) {
+    uint8_t i;
+    
+    pool->numThreads = 0;
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->stop = 0;
+    pool->projected = 0;
+    pool->projectedAllocated = 0;
+    pool->screen = 0;
+    pool->visible = 0;
+    pool->tileStart = 0;
+    pool->tileTriangles = 0;
+    pool->tileTrianglesAllocated = 0;
+    pool->tilesAllocated = 0;
+    pool->threads = malloc(numThreads * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, 0);
+    pthread_cond_init(&pool->start, 0);
+    pthread_cond_init(&pool->done, 0);
+    if ((pool->threads == 0) && (numThreads > 0)) {
+        Render_Engine_PoolDestroy(pool);
+        return 0;
+    }
+    
+    for (i = 0; i < numThreads; i++) {
+        if (pthread_create(&pool->threads[i], 0, renderWorker, pool) != 0) {
+            // Stop the threads already started
+            Render_Engine_PoolDestroy(pool);
+            return 0;
+        }
+        pool->numThreads++;
+    }
+    
+    return 1;
+}
+
+void Render_Engine_PoolDestroy(render_pool_t *pool) {
+    uint8_t i;
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->numThreads; i++) {
+        pthread_join(pool->threads[i], 0);
+    }
+    
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    freePool(pool);
+}
+
+void Render_Engine_RenderFrameParallel(world_t *world, camera_t *camera,
+        framebuffer_t *frame, render_pool_t *pool) {
+    render_order_t order[RENDER_ORDER_SIZE(world)];
+    render_context_t *context = &pool->context;
+    render_projected_t *projected;
+    triangle_t instanced;
+    triangle_t *triangle;
+    uint16_t tilesHigh;
+    uint32_t numProjected = 0;
+    uint32_t numEntries = 0;
+    uint32_t i, x, y, tile, index;
+    uint8_t fog;
+    
+    Render_Engine_BeginFrame(context, world, camera, frame, order);
+    pool->tilesWide = (frame->width + RENDER_TILE_WIDTH - 1) / RENDER_TILE_WIDTH;
+    tilesHigh = (frame->height + RENDER_TILE_HEIGHT - 1) / RENDER_TILE_HEIGHT;
+    pool->numTiles = (uint32_t) pool->tilesWide * tilesHigh;
+    
+    // Make room for the biggest frame seen so far
+    if (pool->projectedAllocated < RENDER_ORDER_SIZE(world)) {
+        free(pool->projected);
+        free(pool->screen);
+        free(pool->visible);
+        pool->projected = malloc(RENDER_ORDER_SIZE(world) * sizeof(render_projected_t));
+        pool->screen = malloc(RENDER_VERTEX_STRIDE(RENDER_ORDER_SIZE(world)) *
+                sizeof(point_t));
+        pool->visible = malloc(RENDER_VERTEX_STRIDE(RENDER_ORDER_SIZE(world)));
+        pool->projectedAllocated = RENDER_ORDER_SIZE(world);
+        if ((pool->projected == 0) || (pool->screen == 0) || (pool->visible == 0)) {
+            freePool(pool);
+            Render_Engine_RenderFrame(world, camera, frame);
+            return;
+        }
+    }
+    if ((world->scene != 0) || (world->vertices != 0)) {
+        Render_Engine_ProjectVertices(context, pool->screen, pool->visible);
+    }
+    if (pool->tilesAllocated < pool->numTiles + 1) {
+        free(pool->tileStart);
+        pool->tileStart = malloc((pool->numTiles + 1) * sizeof(uint32_t));
+        pool->tilesAllocated = pool->numTiles + 1;
+        if (pool->tileStart == 0) {
+            freePool(pool);
+            Render_Engine_RenderFrame(world, camera, frame);
+            return;
+        }
+    }
+    for (tile = 0; tile <= pool->numTiles; tile++) {
+        pool->tileStart[tile] = 0;
+    }
+    
+    // Project the visible triangles once, farthest first, and count how many
+    // land in each tile
+    while ((triangle = nextTriangle(context, &instanced, &index, &fog)) != 0) {
+        projected = &pool->projected[numProjected];
+        if (!projectTriangle(context, index, triangle,
+                &projected->p1, &projected->p2, &projected->p3)) {
+            continue;
+        }
+        projected->color = fog ? context->camera.fogColor : triangle->color;
+        
+        // Painting never strays more than a pixel from the corners
+        if ((fmax(fmax(projected->p1.x, projected->p2.x), projected->p3.x) < -1) ||
+                (fmin(fmin(projected->p1.x, projected->p2.x), projected->p3.x) > frame->width) ||
+                (fmax(fmax(projected->p1.y, projected->p2.y), projected->p3.y) < -1) ||
+                (fmin(fmin(projected->p1.y, projected->p2.y), projected->p3.y) > frame->height)) {
+            continue;
+        }
+        projected->tileLeft = screenToTile(projected->p1.x, projected->p2.x,
+                projected->p3.x, frame->width, RENDER_TILE_WIDTH, 0);
+        projected->tileRight = screenToTile(projected->p1.x, projected->p2.x,
+                projected->p3.x, frame->width, RENDER_TILE_WIDTH, 1);
+        projected->tileTop = screenToTile(projected->p1.y, projected->p2.y,
+                projected->p3.y, frame->height, RENDER_TILE_HEIGHT, 0);
+        projected->tileBottom = screenToTile(projected->p1.y, projected->p2.y,
+                projected->p3.y, frame->height, RENDER_TILE_HEIGHT, 1);
+        for (y = projected->tileTop; y <= projected->tileBottom; y++) {
+            for (x = projected->tileLeft; x <= projected->tileRight; x++) {
+                pool->tileStart[(y * pool->tilesWide) + x + 1]++;
             }
-            if (min > p3.y) {
-                min = p3.y;
+        }
+        numProjected++;
+    }
+    
+    // Give every tile its own run of the list, in painting order
+    for (tile = 0; tile < pool->numTiles; tile++) {
+        pool->tileStart[tile + 1] += pool->tileStart[tile];
+    }
+    numEntries = pool->tileStart[pool->numTiles];
+    if (pool->tileTrianglesAllocated < numEntries) {
+        free(pool->tileTriangles);
+        pool->tileTriangles = malloc(numEntries * sizeof(uint32_t));
+        pool->tileTrianglesAllocated = numEntries;
+        if (pool->tileTriangles == 0) {
+            freePool(pool);
+            Render_Engine_RenderFrame(world, camera, frame);
+            return;
+        }
+    }
+    for (i = 0; i < numProjected; i++) {
+        projected = &pool->projected[i];
+        for (y = projected->tileTop; y <= projected->tileBottom; y++) {
+            for (x = projected->tileLeft; x <= projected->tileRight; x++) {
+                pool->tileTriangles[pool->tileStart[(y * pool->tilesWide) + x]++] = i;
             }
+        }
+    }
+    
+    // Filling the lists moved each start to the next tile, move them back
+    for (tile = pool->numTiles; tile > 0; tile--) {
+        pool->tileStart[tile] = pool->tileStart[tile - 1];
+    }
+    pool->tileStart[0] = 0;
+    
+    // Wake up the workers and help them paint
+    pthread_mutex_lock(&pool->lock);
+    pool->nextTile = 0;
+    pool->busy = pool->numThreads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    paintTiles(pool);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void Render_Engine_ScratchInit(render_scratch_t *scratch) {
+    scratch->order = 0;
+    scratch->screen = 0;
+    scratch->visible = 0;
+    scratch->allocated = 0;
+}
+
+void Render_Engine_ScratchFree(render_scratch_t *scratch) {
+    free(scratch->order);
+    free(scratch->screen);
+    free(scratch->visible);
+    Render_Engine_ScratchInit(scratch);
+}
+
+void Render_Engine_RenderFrameScratch(world_t *world, camera_t *camera,
+        framebuffer_t *frame, render_scratch_t *scratch) {
+    render_context_t context;
+    
+    // Make room for the biggest world seen so far
+    if (scratch->allocated < RENDER_ORDER_SIZE(world)) {
+        Render_Engine_ScratchFree(scratch);
+        scratch->order = malloc(RENDER_ORDER_SIZE(world) * sizeof(render_order_t));
+        scratch->screen = malloc(RENDER_VERTEX_STRIDE(RENDER_ORDER_SIZE(world)) *
+                sizeof(point_t));
+        scratch->visible = malloc(RENDER_VERTEX_STRIDE(RENDER_ORDER_SIZE(world)));
+        if ((scratch->order == 0) || (scratch->screen == 0) || (scratch->visible == 0)) {
+            // Out of memory, the stack of the worker holds the frame instead
+            Render_Engine_ScratchFree(scratch);
+            Render_Engine_RenderFrame(world, camera, frame);
+            return;
+        }
+        scratch->allocated = RENDER_ORDER_SIZE(world);
+    }
+    
+    Render_Engine_BeginFrame(&context, world, camera, frame, scratch->order);
+    if ((world->scene != 0) || (world->vertices != 0)) {
+        Render_Engine_ProjectVertices(&context, scratch->screen, scratch->visible);
+    }
+    Render_Engine_FinishFrame(&context);
+}
+
+uint8_t Render_Engine_WorkersInit(render_workers_t *workers, uint8_t numWorkers,
+        uint16_t maxJobs, render_notify_t notify, void *data) {
+    render_worker_t *worker;
+    uint8_t i;
+    
+    workers->numWorkers = 0;
+    workers->nextWorker = 0;
+    workers->maxJobs = maxJobs;
+    workers->queued = 0;
+    workers->inFlight = 0;
+    workers->doneHead = 0;
+    workers->doneCount = 0;
+    workers->stop = 0;
+    workers->notify = notify;
+    workers->notifyData = data;
+    workers->workers = malloc(numWorkers * sizeof(render_worker_t));
+    workers->done = malloc(maxJobs * sizeof(render_job_t *));
+    pthread_mutex_init(&workers->lock, 0);
+    pthread_cond_init(&workers->wake, 0);
+    if ((workers->workers == 0) || (workers->done == 0) || (numWorkers == 0)) {
+        Render_Engine_WorkersDestroy(workers);
+        return 0;
+    }
+    
+    // Nothing is queued yet, so no thread looks at a queue that is not set up
+    for (i = 0; i < numWorkers; i++) {
+        worker = &workers->workers[i];
+        worker->workers = workers;
+        worker->queue = malloc(maxJobs * sizeof(render_job_t *));
+        worker->head = 0;
+        worker->count = 0;
+        worker->rendered = 0;
+        worker->stolen = 0;
+        Render_Engine_ScratchInit(&worker->scratch);
+        pthread_mutex_init(&worker->lock, 0);
+        if ((worker->queue == 0) ||
+                (pthread_create(&worker->thread, 0, jobWorker, worker) != 0)) {
+            free(worker->queue);
+            pthread_mutex_destroy(&worker->lock);
             
-            rounding_t y;
-            for (y = max; y > min; y--) {
-                paintPixelf(frame, center.x, y, triangles[i].color);
+            // Stop the workers already started
+            Render_Engine_WorkersDestroy(workers);
+            return 0;
+        }
+        workers->numWorkers++;
+    }
+    
+    return 1;
+}
+
+void Render_Engine_WorkersDestroy(render_workers_t *workers) {
+    render_worker_t *worker;
+    uint8_t i;
+    
+    pthread_mutex_lock(&workers->lock);
+    workers->stop = 1;
+    pthread_cond_broadcast(&workers->wake);
+    pthread_mutex_unlock(&workers->lock);
+    for (i = 0; i < workers->numWorkers; i++) {
+        worker = &workers->workers[i];
+        pthread_join(worker->thread, 0);
+        pthread_mutex_destroy(&worker->lock);
+        free(worker->queue);
+        Render_Engine_ScratchFree(&worker->scratch);
+    }
+    
+    pthread_mutex_destroy(&workers->lock);
+    pthread_cond_destroy(&workers->wake);
+    free(workers->workers);
+    free(workers->done);
+}
+
+uint8_t Render_Engine_SubmitJob(render_workers_t *workers, render_job_t *job) {
+    render_worker_t *worker;
+    
+    pthread_mutex_lock(&workers->lock);
+    if (workers->inFlight == workers->maxJobs) {
+        pthread_mutex_unlock(&workers->lock);
+        return 0;
+    }
+    
+    // Deal the jobs out in turn, stealing evens out frames of different cost
+    worker = &workers->workers[workers->nextWorker];
+    workers->nextWorker = (workers->nextWorker + 1) % workers->numWorkers;
+    pthread_mutex_lock(&worker->lock);
+    worker->queue[(worker->head + worker->count) % workers->maxJobs] = job;
+    worker->count++;
+    pthread_mutex_unlock(&worker->lock);
+    workers->inFlight++;
+    workers->queued++;
+    pthread_cond_signal(&workers->wake);
+    pthread_mutex_unlock(&workers->lock);
+    return 1;
+}
+
+uint16_t Render_Engine_CollectJobs(render_workers_t *workers, render_job_t **jobs,
+        uint16_t maxJobs) {
+    uint16_t count = 0;
+    
+    pthread_mutex_lock(&workers->lock);
+    while ((count < maxJobs) && (workers->doneCount > 0)) {
+        jobs[count++] = workers->done[workers->doneHead];
+        workers->doneHead = (workers->doneHead + 1) % workers->maxJobs;
+        workers->doneCount--;
+        workers->inFlight--;
+    }
+    pthread_mutex_unlock(&workers->lock);
+    return count;
+}
+#endif
+
+// Rendering helper functions
+triangle_t *worldTriangle(world_t *world, uint32_t index, triangle_t *instanced) {
+    uint32_t low = 0;
+    uint32_t high;
+    uint32_t middle;
+    
+    if (world->instances == 0) {
+        return &world->triangles[index];
+    }
+    
+    // Meshes are often the same size, so guess as if they were before
+    // searching for the last instance starting at or before the triangle
+    high = world->numInstances - 1;
+    middle = ((uint64_t) index * world->numInstances) / world->numTriangles;
+    if (world->instances[middle].first <= index) {
+        low = middle;
+        if ((middle < high) && (world->instances[middle + 1].first > index)) {
+            high = middle;
+        }
+    } else {
+        high = middle - 1;
+    }
+    while (low < high) {
+        middle = (low + high + 1) / 2;
+        if (world->instances[middle].first <= index) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    
+    placeTriangle(world, world->meshes, &world->instances[low],
+            index - world->instances[low].first, instanced);
+    return instanced;
+}
+
+triangle_t *objectTriangle(world_t *world, uint32_t index, triangle_t *instanced) {
+    render_object_pool_t *pool = world->objects;
+    
+    placeTriangle(world, pool->meshes, &pool->objects[index >> RENDER_OBJECT_SHIFT],
+            index & ((1 << RENDER_OBJECT_SHIFT) - 1), instanced);
+    return instanced;
+}
+
+void placeTriangle(world_t *world, const render_mesh_t *meshes,
+        const render_instance_t *instance, uint32_t index, triangle_t *instanced) {
+    const render_mesh_t *mesh = &meshes[instance->mesh];
+    
+    if (mesh->triangles != 0) {
+        *instanced = mesh->triangles[index];
+    } else {
+        const render_packed_triangle_t *packed = &mesh->packed[index];
+        unpackCorner(packed->p1, world->gridScale, &instanced->p1);
+        unpackCorner(packed->p2, world->gridScale, &instanced->p2);
+        unpackCorner(packed->p3, world->gridScale, &instanced->p3);
+        instanced->color = packed->color;
+    }
+    instanced->p1.x += instance->offset.x;
+    instanced->p1.y += instance->offset.y;
+    instanced->p1.z += instance->offset.z;
+    instanced->p2.x += instance->offset.x;
+    instanced->p2.y += instance->offset.y;
+    instanced->p2.z += instance->offset.z;
+    instanced->p3.x += instance->offset.x;
+    instanced->p3.y += instance->offset.y;
+    instanced->p3.z += instance->offset.z;
+    if (instance->color != 0) {
+        instanced->color = instance->color;
+    }
+}
+
+void unpackCorner(const int8_t *packed, rounding_t scale, vector_t *corner) {
+    corner->x = packed[0] * scale;
+    corner->y = packed[1] * scale;
+    corner->z = packed[2] * scale;
+}
+
+triangle_t *nextTriangle(render_context_t *context, triangle_t *instanced,
+        uint32_t *index, uint8_t *fog) {
+    render_order_t *order = context->order;
+    render_order_t *objects = context->objectOrder;
+    
+    // Merge the two orders, on a tie the world is painted first so objects
+    // standing on it stay in front
+    if ((context->objectNext < context->objectCount) &&
+            ((context->next >= context->orderCount) ||
+            (objects[context->objectNext].distance > order[context->next].distance))) {
+        *index = RENDER_OBJECT_INDEX;
+        *fog = context->objectNext < context->objectFogCount;
+        return objectTriangle(context->world, objects[context->objectNext++].index,
+                instanced);
+    }
+    if (context->next < context->orderCount) {
+        *index = order[context->next].index;
+        *fog = context->next < context->fogCount;
+        context->next++;
+        return worldTriangle(context->world, *index, instanced);
+    }
+    return 0;
+}
+
+uint32_t orderScene(render_context_t *context, render_order_t *order) {
+    world_t *world = context->world;
+    render_scene_t *scene = world->scene;
+    render_vertices_t *vertices = &scene->vertices;
+    vector_t location = context->camera.location;
+    rounding_t angle = context->cameraHorizontalAngle;
+    uint32_t count = 0;
+    uint32_t i;
+    uint8_t k, front;
+    
+    // A triangle is past the left side of the view when its sphere is past
+    // the plane through the left edge of the view and left of the plane
+    // through the camera just short of straight behind it. Corners behind the
+    // camera wrap around to the other side of the screen, so only triangles
+    // between the two planes are never painted. Same for the right side
+    rounding_t margin = RENDER_SCENE_MARGIN * context->anglePerPixelHorizontal;
+    rounding_t edge = (context->camera.fovHorizontal * M_PI / 360.0) + margin;
+    uint8_t cull = edge < M_PI - margin;
+    vector_t leftEdge = {-sin(angle + edge), cos(angle + edge), 0};
+    vector_t leftBack = {-sin(angle - margin), cos(angle - margin), 0};
+    vector_t rightEdge = {sin(angle - edge), -cos(angle - edge), 0};
+    vector_t rightBack = {sin(angle + margin), -cos(angle + margin), 0};
+    rounding_t farDistance = context->camera.farDistance * context->camera.farDistance;
+    rounding_t distance;
+    
+    for (i = 0; i < world->numTriangles; i++) {
+        // Cheapest test first, same distance as the one the order is sorted by
+        distance = distanceToPoint(scene->centers[i], location);
+        if ((context->camera.farDistance > 0) && (distance > farDistance)) {
+            continue;
+        }
+        
+        // Same in front test as projectTriangle()
+        front = 0;
+        for (k = 0; k < 3; k++) {
+            uint32_t corner = scene->corners[(3 * i) + k];
+            vector_t delta = {vertices->x[corner] - location.x,
+                    vertices->y[corner] - location.y,
+                    vertices->z[corner] - location.z};
+            front |= !(dotProduct(delta, context->cameraDirection) <= 0);
+        }
+        if (!front) {
+            continue;
+        }
+        
+        vector_t center = {scene->centers[i].x - location.x,
+                scene->centers[i].y - location.y, scene->centers[i].z - location.z};
+        rounding_t radius = scene->radii[i];
+        if (cull && (((dotProduct(center, leftEdge) > radius) &&
+                (dotProduct(center, leftBack) > radius)) ||
+                ((dotProduct(center, rightEdge) > radius) &&
+                (dotProduct(center, rightBack) > radius)))) {
+            continue;
+        }
+        
+        order[count].distance = distance;
+        order[count].index = i;
+        count++;
+    }
+    
+    return count;
+}
+
+uint32_t orderObjects(render_context_t *context, render_order_t *order) {
+    render_object_pool_t *pool = context->world->objects;
+    rounding_t farDistance = context->camera.farDistance * context->camera.farDistance;
+    uint32_t count = 0;
+    uint32_t index;
+    uint16_t i, k;
+    
+    for (i = 0; i < pool->maxObjects; i++) {
+        if (pool->objects[i].mesh == RENDER_NO_MESH) {
+            continue;
+        }
+        for (k = 0; k < pool->meshes[pool->objects[i].mesh].numTriangles; k++) {
+            triangle_t instanced;
+            index = ((uint32_t) i << RENDER_OBJECT_SHIFT) | k;
+            rounding_t distance = distanceToTriangle(
+                    objectTriangle(context->world, index, &instanced),
+                    context->camera.location);
+            if ((context->camera.farDistance > 0) && (distance > farDistance)) {
+                continue;
             }
-        } else if ((left.x == center.x) || (center.x == right.x)) {
-            // Two points are in line vertically
-            point_t top, bottom, side;
-            uint8_t leftDirection;
-            if (left.x == center.x) {
-                if (left.y > center.y) {
-                    top = left;
-                    bottom = center;
-                } else {
-                    top = center;
-                    bottom = left;
-                }
-                side = right;
-                leftDirection = 0;
-            } else {
-                if (right.y > center.y) {
-                    top = right;
-                    bottom = center;
-                } else {
-                    top = center;
-                    bottom = right;
-                }
-                side = left;
-                leftDirection = 1;
+            order[count].distance = distance;
+            order[count].index = index;
+            count++;
+        }
+    }
+    
+    return count;
+}
+
+uint32_t countFog(render_order_t *order, uint32_t count, rounding_t fogDistance) {
+    uint32_t fogCount = 0;
+    
+    // Farthest first, so the triangles in the fog lead the order
+    if (fogDistance > 0) {
+        while ((fogCount < count) && (order[fogCount].distance > fogDistance)) {
+            fogCount++;
+        }
+    }
+    return fogCount;
+}
+
+void projectScene(render_context_t *context, point_t *screen, uint8_t *needed) {
+    render_scene_t *scene = context->world->scene;
+    render_vertices_t *vertices = &scene->vertices;
+    rounding_t dx[RENDER_VERTEX_BATCH];
+    rounding_t dy[RENDER_VERTEX_BATCH];
+    rounding_t dz[RENDER_VERTEX_BATCH];
+    double horizontal[RENDER_VERTEX_BATCH];
+    uint32_t first, i;
+    uint32_t *corners;
+    
+    // Only the corners of triangles in the order are needed
+    memset(needed, 0, vertices->count);
+    for (i = 0; i < context->orderCount; i++) {
+        corners = scene->corners + (3 * context->order[i].index);
+        needed[corners[0]] = 1;
+        needed[corners[1]] = 1;
+        needed[corners[2]] = 1;
+    }
+    
+    for (first = 0; first < vertices->count; first += RENDER_VERTEX_BATCH) {
+        transformVertices(context, vertices, first, dx, dy, dz, horizontal);
+        
+#ifdef RENDER_ENGINE_FAST_MATH
+        // Cheaper to project the whole batch in one vectorized loop
+        for (i = 0; i < RENDER_VERTEX_BATCH; i++) {
+            vector_t delta = {dx[i], dy[i], dz[i]};
+            screen[first + i] = pointToScreen(context, delta,
+                    Render_Engine_FastSqrt((dx[i] * dx[i]) + (dy[i] * dy[i])));
+        }
+#else
+        for (i = 0; (i < RENDER_VERTEX_BATCH) && (first + i < vertices->count); i++) {
+            if (needed[first + i]) {
+                vector_t delta = {dx[i], dy[i], dz[i]};
+                screen[first + i] = pointToScreen(context, delta, horizontal[i]);
             }
-            
-            // Calculate the slope of the lines
-            rounding_t upperSlope = (top.y - side.y) / (top.x - side.x);
-            rounding_t lowerSlope = (bottom.y - side.y) / (bottom.x - side.x);
-            
-            rounding_t x, y;
-            rounding_t topY, bottomY;
-            if (leftDirection) {
-                // Go through triangle horizontally
-                for (x = top.x; x > side.x; x--) {
-                    // Calculate the min and max y values
-                    topY = (upperSlope * (x - side.x)) + side.y;
-                    bottomY = (lowerSlope * (x - side.x)) + side.y;
-                    
-                    // Paint vertical column of triangle
-                    for (y = topY; y > bottomY; y--) {
-                        paintPixelf(frame, x, y, triangles[i].color);
-                    }
-                    
-                    // Catch one more paint
-                    paintPixelf(frame, x, bottomY, triangles[i].color);
-                    
-                    // Correct sampling to the middle of the pixel
-                    if ((x - floor(x)) != 0.5) {
-                        x = floor(x) + 0.5;
-                    }
-                }
-                
-                // Paint one more pixel over if the side is just over the edge
-                if ((side.x - fabs(side.x)) > 0.5) {
-                    paintPixelf(frame, side.x, side.y, triangles[i].color);
-                }
+        }
+#endif
+    }
+    
+    context->screen = screen;
+    context->visible = 0;
+}
+
+#ifdef RENDER_ENGINE_THREADS
+void *renderWorker(void *data) {
+    render_pool_t *pool = data;
+    uint32_t generation = 0;
+    
+    while (1) {
+        // Sleep until there is a new frame to paint
+        pthread_mutex_lock(&pool->lock);
+        while ((pool->generation == generation) && !pool->stop) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            return 0;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        
+        paintTiles(pool);
+        
+        pthread_mutex_lock(&pool->lock);
+        pool->busy--;
+        pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void paintTiles(render_pool_t *pool) {
+    render_context_t context = pool->context;
+    render_projected_t *projected;
+    uint32_t tile, i;
+    
+    // Take tiles until there are none left, each tile only paints inside
+    // itself so no two threads write the same pixel
+    while ((tile = __sync_fetch_and_add(&pool->nextTile, 1)) < pool->numTiles) {
+        context.clipLeft = (tile % pool->tilesWide) * RENDER_TILE_WIDTH;
+        context.clipTop = (tile / pool->tilesWide) * RENDER_TILE_HEIGHT;
+        context.clipRight = context.clipLeft + RENDER_TILE_WIDTH;
+        context.clipBottom = context.clipTop + RENDER_TILE_HEIGHT;
+        if (context.clipRight > context.frame->width) {
+            context.clipRight = context.frame->width;
+        }
+        if (context.clipBottom > context.frame->height) {
+            context.clipBottom = context.frame->height;
+        }
+        
+        for (i = pool->tileStart[tile]; i < pool->tileStart[tile + 1]; i++) {
+            projected = &pool->projected[pool->tileTriangles[i]];
+            rasterTriangle(&context, projected->p1, projected->p2,
+                    projected->p3, projected->color);
+        }
+    }
+}
+
+void freePool(render_pool_t *pool) {
+    // Every buffer is grown again by the next frame
+    free(pool->projected);
+    free(pool->screen);
+    free(pool->visible);
+    free(pool->tileStart);
+    free(pool->tileTriangles);
+    pool->projected = 0;
+    pool->screen = 0;
+    pool->visible = 0;
+    pool->tileStart = 0;
+    pool->tileTriangles = 0;
+    pool->projectedAllocated = 0;
+    pool->tilesAllocated = 0;
+    pool->tileTrianglesAllocated = 0;
+}
+
+uint16_t screenToTile(rounding_t a, rounding_t b, rounding_t c,
+        uint16_t size, uint16_t tileSize, uint8_t last) {
+    // Pad by a pixel as painting may round just past a corner
+    rounding_t edge = last ? (fmax(fmax(a, b), c) + 1) : (fmin(fmin(a, b), c) - 1);
+    
+    if (edge < 0) {
+        return 0;
+    } else if (edge >= size) {
+        return (size - 1) / tileSize;
+    } else {
+        return ((uint16_t) edge) / tileSize;
+    }
+}
+
+void *jobWorker(void *data) {
+    render_worker_t *worker = data;
+    render_workers_t *workers = worker->workers;
+    render_job_t *job;
+    
+    while (1) {
+        // Sleep until a job is waiting in any queue
+        pthread_mutex_lock(&workers->lock);
+        while ((workers->queued == 0) && !workers->stop) {
+            pthread_cond_wait(&workers->wake, &workers->lock);
+        }
+        if (workers->stop) {
+            pthread_mutex_unlock(&workers->lock);
+            return 0;
+        }
+        pthread_mutex_unlock(&workers->lock);
+        
+        // Another worker may have taken the job first
+        job = takeJob(worker);
+        if (job == 0) {
+            continue;
+        }
+        Render_Engine_RenderFrameScratch(job->world, &job->camera, &job->frame,
+                &worker->scratch);
+        worker->rendered++;
+        
+        pthread_mutex_lock(&workers->lock);
+        workers->done[(workers->doneHead + workers->doneCount) % workers->maxJobs] = job;
+        workers->doneCount++;
+        pthread_mutex_unlock(&workers->lock);
+        if (workers->notify != 0) {
+            workers->notify(workers->notifyData);
+        }
+    }
+}
+
+render_job_t *takeJob(render_worker_t *worker) {
+    render_workers_t *workers = worker->workers;
+    render_worker_t *victim = worker;
+    render_job_t *job = 0;
+    uint8_t i;
+    
+    // Own queue first, then the others starting with the next one. Always the
+    // oldest job, so no frame waits long behind ones queued after it
+    for (i = 0; (job == 0) && (i < workers->numWorkers); i++) {
+        victim = &workers->workers[((worker - workers->workers) + i) %
+                workers->numWorkers];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->count > 0) {
+            job = victim->queue[victim->head];
+            victim->head = (victim->head + 1) % workers->maxJobs;
+            victim->count--;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    if (job == 0) {
+        return 0;
+    }
+    if (victim != worker) {
+        worker->stolen++;
+    }
+    
+    pthread_mutex_lock(&workers->lock);
+    workers->queued--;
+    pthread_mutex_unlock(&workers->lock);
+    return job;
+}
+#endif
+
+uint8_t projectTriangle(render_context_t *context, uint32_t index,
+        triangle_t *triangle, point_t *p1, point_t *p2, point_t *p3) {
+    vector_t p1Delta, p2Delta, p3Delta;
+    
+    // Corners projected by Render_Engine_ProjectVertices() only need copying
+    if ((context->screen != 0) && (index != RENDER_OBJECT_INDEX)) {
+        // A scene only puts triangles that may be seen in the order
+        if (context->world->scene != 0) {
+            uint32_t *corners = context->world->scene->corners + (3 * index);
+            *p1 = context->screen[corners[0]];
+            *p2 = context->screen[corners[1]];
+            *p3 = context->screen[corners[2]];
+            return 1;
+        }
+        if (!context->visible[index]) {
+            return 0;
+        }
+        *p1 = context->screen[3 * index];
+        *p2 = context->screen[(3 * index) + 1];
+        *p3 = context->screen[(3 * index) + 2];
+        return 1;
+    }
+    
+    // Calculate the difference between point location and camera
+    p1Delta.x = triangle->p1.x - context->camera.location.x;
+    p1Delta.y = triangle->p1.y - context->camera.location.y;
+    p1Delta.z = triangle->p1.z - context->camera.location.z;
+    p2Delta.x = triangle->p2.x - context->camera.location.x;
+    p2Delta.y = triangle->p2.y - context->camera.location.y;
+    p2Delta.z = triangle->p2.z - context->camera.location.z;
+    p3Delta.x = triangle->p3.x - context->camera.location.x;
+    p3Delta.y = triangle->p3.y - context->camera.location.y;
+    p3Delta.z = triangle->p3.z - context->camera.location.z;
+    
+    // Make sure at least one point is in front of the camera
+    if ((dotProduct(p1Delta, context->cameraDirection) <= 0) &&
+            (dotProduct(p2Delta, context->cameraDirection) <= 0) &&
+            (dotProduct(p3Delta, context->cameraDirection) <= 0)) {
+        return 0;
+    }
+    
+    // Calculate the screen coordinates
+    *p1 = pointToScreen(context, p1Delta,
+            engineSqrt((p1Delta.x * p1Delta.x) + (p1Delta.y * p1Delta.y)));
+    *p2 = pointToScreen(context, p2Delta,
+            engineSqrt((p2Delta.x * p2Delta.x) + (p2Delta.y * p2Delta.y)));
+    *p3 = pointToScreen(context, p3Delta,
+            engineSqrt((p3Delta.x * p3Delta.x) + (p3Delta.y * p3Delta.y)));
+    return 1;
+}
+
+void rasterTriangle(render_context_t *context,
+        point_t p1, point_t p2, point_t p3, uint8_t color) {
+    framebuffer_t *frame = context->frame;
+    render_area_t area = {frame->buffer, 1, frame->width, context->clipLeft,
+            context->clipTop, context->clipRight, context->clipBottom};
+    
+    if (frame->layout == RenderLayoutColumns) {
+        area.columnStep = frame->height;
+        area.rowStep = 1;
+    }
+    
+#ifdef RENDER_ENGINE_FIXED_WIDTH
+    // Whole row layout frames of the fixed size use the copy with constant
+    // bounds
+    if ((area.columnStep == 1) && (area.rowStep == RENDER_ENGINE_FIXED_WIDTH) &&
+            (area.left == 0) && (area.top == 0) &&
+            (area.right == RENDER_ENGINE_FIXED_WIDTH) &&
+            (area.bottom == RENDER_ENGINE_FIXED_HEIGHT)) {
+        render_area_t fixed = {area.buffer, 1, RENDER_ENGINE_FIXED_WIDTH, 0, 0,
+                RENDER_ENGINE_FIXED_WIDTH, RENDER_ENGINE_FIXED_HEIGHT};
+        rasterArea(fixed, p1, p2, p3, color);
+        return;
+    }
+#endif
+    rasterArea(area, p1, p2, p3, color);
+}
+
+RENDER_INLINE void rasterArea(render_area_t area,
+        point_t p1, point_t p2, point_t p3, uint8_t color) {
+    uint8_t leftSel, rightSel;
+    point_t left, right, center;
+    
+    // Determine the left point of the triangle
+    left = p1;
+    leftSel = 1;
+    if (left.x > p2.x) {
+        left = p2;
+        leftSel = 2;
+    }
+    if (left.x > p3.x) {
+        left = p3;
+        leftSel = 3;
+    }
+    
+    // Determine the right point of the triangle
+    right = p3;
+    rightSel = 3;
+    if (((right.x < p2.x) || (leftSel == 3)) && (leftSel != 2)) {
+        right = p2;
+        rightSel = 2;
+    }
+    if ((right.x < p1.x) && (leftSel != 1)) {
+        right = p1;
+        rightSel = 1;
+    }
+    
+    // Determine the center point of the triangle
+    if ((leftSel + rightSel) == 3) {
+        center = p3;
+    } else if ((leftSel + rightSel) == 4) {
+        center = p2;
+    } else if ((leftSel + rightSel) == 5) {
+        center = p1;
+    }
+    
+    // Determine the number of triangles to paint
+    if ((left.x == center.x) && (center.x == right.x)) {
+        // One vertical line
+        if ((center.x < 0) || (center.x >= area.right)) {
+            // Skip rendering if this will not actually be displayed
+            return;
+        }
+        
+        rounding_t max = p1.y;
+        if (max < p2.y) {
+            max = p2.y;
+        }
+        if (max < p3.y) {
+            max = p3.y;
+        }
+        rounding_t min = p1.y;
+        if (min > p2.y) {
+            min = p2.y;
+        }
+        if (min > p3.y) {
+            min = p3.y;
+        }
+        
+        rounding_t y;
+        for (y = max; y > min; y--) {
+            paintPixelf(area, center.x, y, color);
+        }
+    } else if ((left.x == center.x) || (center.x == right.x)) {
+        // Two points are in line vertically
+        point_t top, bottom, side;
+        uint8_t leftDirection;
+        if (left.x == center.x) {
+            if (left.y > center.y) {
+                top = left;
+                bottom = center;
             } else {
-                // Go through triangle horizontally
-                for (x = top.x; x < side.x; x++) {
-                    // Calculate the min and max y values
-                    topY = (upperSlope * (x - side.x)) + side.y;
-                    bottomY = (lowerSlope * (x - side.x)) + side.y;
-                    
-                    // Paint vertical column of triangle
-                    for (y = topY; y > bottomY; y--) {
-                        paintPixelf(frame, x, y, triangles[i].color);
-                    }
-                    
-                    // Catch one more paint
-                    paintPixelf(frame, x, bottomY, triangles[i].color);
-                    
-                    // Correct sampling to the middle of the pixel
-                    if ((x - floor(x)) != 0.5) {
-                        x = floor(x) + 0.5;
-                    }
-                }
-                
-                // Paint one more pixel over if the side is just over the edge
-                if ((side.x - floor(side.x)) < 0.5) {
-                    paintPixelf(frame, side.x, side.y, triangles[i].color);
-                }
+                top = center;
+                bottom = left;
             }
+            side = right;
+            leftDirection = 0;
         } else {
-            // Points are not directly in line vertically
-            rounding_t slopeLeftCenter = (center.y - left.y) / (center.x - left.x);
-            rounding_t slopeLeftRight = (right.y - left.y) / (right.x - left.x);
-            rounding_t slopeCenterRight = (right.y - center.y) / (right.x - center.x);
-            rounding_t x, y;
-            rounding_t topY, bottomY;
-            
-            // Left to center
-            for (x = left.x; x < center.x; x++) {
-                // Make sure rendering is only done if the point is visible
-                if ((x < 0) || (x >= frame->width)) {
-                    continue;
+            if (right.y > center.y) {
+                top = right;
+                bottom = center;
+            } else {
+                top = center;
+                bottom = right;
+            }
+            side = left;
+            leftDirection = 1;
+        }
+        
+        // Calculate the slope of the lines
+        rounding_t upperSlope = (top.y - side.y) / (top.x - side.x);
+        rounding_t lowerSlope = (bottom.y - side.y) / (bottom.x - side.x);
+        
+        rounding_t x;
+        rounding_t topY, bottomY;
+        if (leftDirection) {
+            // Go through triangle horizontally
+            for (x = top.x; x > side.x; x--) {
+                // The rest of the columns are left of the clip area
+                if (x < area.left) {
+                    break;
                 }
                 
                 // Calculate the min and max y values
-                topY = (slopeLeftCenter * (x - left.x)) + left.y;
-                bottomY = (slopeLeftRight * (x - left.x)) + left.y;
-                if (topY < bottomY) {
-                    // Flip the numbers around
-                    y = topY;
-                    topY = bottomY;
-                    bottomY = y;
-                }
+                topY = (upperSlope * (x - side.x)) + side.y;
+                bottomY = (lowerSlope * (x - side.x)) + side.y;
                 
-                // Paint the vertical column of the triangle
-                for (y = topY; y > bottomY; y--) {
-                    paintPixelf(frame, x, y, triangles[i].color);
-                }
-                
-                // Catch one more paint
-                paintPixelf(frame, x, bottomY, triangles[i].color);
+                // Paint vertical column of triangle
+                paintColumn(area, x, topY, bottomY, color);
                 
                 // Correct sampling to the middle of the pixel
                 if ((x - floor(x)) != 0.5) {
                     x = floor(x) + 0.5;
                 }
+                
+                // Jump over the columns right of the clip area
+                if (x > area.right + 1) {
+                    x = area.right + 0.5;
+                }
             }
             
-            // Center to right
-            for (x = center.x; x < right.x; x++) {
-                // Make sure rendering is only done if the point is visible
-                if ((x < 0) || (x >= frame->width)) {
-                    continue;
+            // Paint one more pixel over if the side is just over the edge
+            if ((side.x - fabs(side.x)) > 0.5) {
+                paintPixelf(area, side.x, side.y, color);
+            }
+        } else {
+            // Go through triangle horizontally
+            for (x = top.x; x < side.x; x++) {
+                // The rest of the columns are right of the clip area
+                if (x >= area.right) {
+                    break;
                 }
                 
                 // Calculate the min and max y values
-                topY = (slopeCenterRight * (x - right.x)) + right.y;
-                bottomY = (slopeLeftRight * (x - right.x)) + right.y;
-                if (topY < bottomY) {
-                    // Flip the numbers around
-                    y = topY;
-                    topY = bottomY;
-                    bottomY = y;
-                }
-                
-                // Paint the vertical column of the triangle
-                for (y = topY; y > bottomY; y--) {
-                    paintPixelf(frame, x, y, triangles[i].color);
-                }
+                topY = (upperSlope * (x - side.x)) + side.y;
+                bottomY = (lowerSlope * (x - side.x)) + side.y;
                 
-                // Catch one more paint
-                paintPixelf(frame, x, bottomY, triangles[i].color);
+                // Paint vertical column of triangle
+                paintColumn(area, x, topY, bottomY, color);
                 
                 // Correct sampling to the middle of the pixel
                 if ((x - floor(x)) != 0.5) {
                     x = floor(x) + 0.5;
                 }
-            }
                 
-            // Paint one more pixel over if the right is just over the edge
-            if ((right.x - floor(right.x)) < 0.5) {
-                // Make sure rendering is only done if the point is visible
-                if ((right.x >= 0) && (right.x < frame->width)) {
-                    paintPixelf(frame, right.x, right.y, triangles[i].color);
+                // Jump over the columns left of the clip area
+                if (x < area.left - 1) {
+                    x = area.left - 0.5;
+                }
+            }
+            
+            // Paint one more pixel over if the side is just over the edge
+            if ((side.x - floor(side.x)) < 0.5) {
+                paintPixelf(area, side.x, side.y, color);
+            }
+        }
+    } else {
+        // Points are not directly in line vertically
+        rounding_t slopeLeftCenter = (center.y - left.y) / (center.x - left.x);
+        rounding_t slopeLeftRight = (right.y - left.y) / (right.x - left.x);
+        rounding_t slopeCenterRight = (right.y - center.y) / (right.x - center.x);
+        rounding_t x, y;
+        rounding_t topY, bottomY;
+        
+        // Left to center
+        for (x = left.x; x < center.x; x++) {
+            // Make sure rendering is only done if the point is visible
+            if (x >= area.right) {
+                break;
+            } else if (x < 0) {
+                continue;
+            }
+            
+            // Calculate the min and max y values
+            topY = (slopeLeftCenter * (x - left.x)) + left.y;
+            bottomY = (slopeLeftRight * (x - left.x)) + left.y;
+            if (topY < bottomY) {
+                // Flip the numbers around
+                y = topY;
+                topY = bottomY;
+                bottomY = y;
+            }
+            
+            // Paint the vertical column of the triangle
+            paintColumn(area, x, topY, bottomY, color);
+            
+            // Correct sampling to the middle of the pixel
+            if ((x - floor(x)) != 0.5) {
+                x = floor(x) + 0.5;
+            }
+            
+            // Jump over the columns left of the clip area
+            if (x < area.left - 1) {
+                x = area.left - 0.5;
+            }
+        }
+        
+        // Center to right
+        for (x = center.x; x < right.x; x++) {
+            // Make sure rendering is only done if the point is visible
+            if (x >= area.right) {
+                break;
+            } else if (x < 0) {
+                continue;
+            }
+            
+            // Calculate the min and max y values
+            topY = (slopeCenterRight * (x - right.x)) + right.y;
+            bottomY = (slopeLeftRight * (x - right.x)) + right.y;
+            if (topY < bottomY) {
+                // Flip the numbers around
+                y = topY;
+                topY = bottomY;
+                bottomY = y;
+            }
+            
+            // Paint the vertical column of the triangle
+            paintColumn(area, x, topY, bottomY, color);
+            
+            // Correct sampling to the middle of the pixel
+            if ((x - floor(x)) != 0.5) {
+                x = floor(x) + 0.5;
+            }
+            
+            // Jump over the columns left of the clip area
+            if (x < area.left - 1) {
+                x = area.left - 0.5;
+            }
+        }
+            
+        // Paint one more pixel over if the right is just over the edge
+        if ((right.x - floor(right.x)) < 0.5) {
+            // Make sure rendering is only done if the point is visible
+            if ((right.x >= 0) && (right.x < area.right)) {
+                paintPixelf(area, right.x, right.y, color);
+            }
+        }
+    }
+}
+
+void Render_Engine_TransposeFrame(framebuffer_t *frame, uint8_t *rows) {
+    uint32_t blockX, blockY, x, y, endX, endY;
+    uint8_t *column;
+    
+    if (frame->layout == RenderLayoutRows) {
+        memcpy(rows, frame->buffer, (uint32_t) frame->width * frame->height);
+        return;
+    }
+    
+    // Copy a square block at a time, the block of columns read and the block
+    // of rows written both fit in the cache
+    for (blockY = 0; blockY < frame->height; blockY += RENDER_TRANSPOSE_BLOCK) {
+        endY = blockY + RENDER_TRANSPOSE_BLOCK;
+        if (endY > frame->height) {
+            endY = frame->height;
+        }
+        for (blockX = 0; blockX < frame->width; blockX += RENDER_TRANSPOSE_BLOCK) {
+            endX = blockX + RENDER_TRANSPOSE_BLOCK;
+            if (endX > frame->width) {
+                endX = frame->width;
+            }
+            for (x = blockX; x < endX; x++) {
+                column = frame->buffer + (x * frame->height);
+                for (y = blockY; y < endY; y++) {
+                    rows[x + (y * frame->width)] = column[y];
                 }
             }
         }
     }
 }
 
+uint32_t Render_Engine_EncodeFrame(framebuffer_t *frame, uint8_t *out) {
+    uint16_t columnStep = (frame->layout == RenderLayoutColumns) ? frame->height : 1;
+    uint16_t rowStep = (frame->layout == RenderLayoutColumns) ? 1 : frame->width;
+    uint8_t *start = out;
+    uint8_t *pixel;
+    uint16_t x, y;
+    uint8_t lastColor = 0;
+    
+    // Same bytes as Render_Engine_DisplayFrame(), cursor to the origin first
+    *out++ = '\e';
+    *out++ = '[';
+    *out++ = '1';
+    *out++ = ';';
+    *out++ = '1';
+    *out++ = 'H';
+    for (y = 0; y < frame->height; y++) {
+        if (y > 0) {
+            *out++ = '\r';
+            *out++ = '\n';
+        }
+        
+        pixel = frame->buffer + ((uint32_t) y * rowStep);
+        for (x = 0; x < frame->width; x++) {
+            if (lastColor != *pixel) {
+                lastColor = *pixel;
+                *out++ = '\e';
+                *out++ = '[';
+                out += encodeNumber(out, lastColor);
+                *out++ = 'm';
+            }
+            *out++ = ' ';
+            pixel += columnStep;
+        }
+    }
+    return out - start;
+}
+
+#ifndef RENDER_ENGINE_HOST
 void Render_Engine_DisplayFrame(uint8_t channel, framebuffer_t *frame) {
     // Wait for the transmit buffer to clear
     while (UART_IsTransmitting(channel));
@@ -334,34 +1635,143 @@ void Render_Engine_DisplayFrame(uint8_t channel, framebuffer_t *frame) {
     // Set the cursor to the origin so the new frame tiles across the old frame
     changeTerminalCursorLocation(channel, 0, 0);
     
-    uint16_t i;
-    uint8_t lastColor = 0;
+    if (frame->layout == RenderLayoutColumns) {
+        writeTerminalFrame(channel, frame->buffer, frame->width, frame->height,
+                frame->height, 1);
+        return;
+    }
+#ifdef RENDER_ENGINE_FIXED_WIDTH
+    // Row layout frames of the fixed size use the copy with constant loop
+    // bounds
+    if ((frame->width == RENDER_ENGINE_FIXED_WIDTH) &&
+            (frame->height == RENDER_ENGINE_FIXED_HEIGHT)) {
+        writeTerminalFrame(channel, frame->buffer, RENDER_ENGINE_FIXED_WIDTH,
+                RENDER_ENGINE_FIXED_HEIGHT, 1, RENDER_ENGINE_FIXED_WIDTH);
+        return;
+    }
+#endif
+    writeTerminalFrame(channel, frame->buffer, frame->width, frame->height,
+            1, frame->width);
+}
+#endif
+
+uint32_t transformVertices(render_context_t *context, render_vertices_t *vertices,
+        uint32_t first, rounding_t *dx, rounding_t *dy, rounding_t *dz,
+        double *horizontal) {
+    vector_t *location = &context->camera.location;
+    vector_t *direction = &context->cameraDirection;
+    uint32_t front = 0;
+    uint8_t i;
+#ifdef RENDER_ENGINE_FAST_MATH
+    (void) horizontal;
+#endif
     
-    // Access the UART through the HAL directly to get around the buffer
-    for (i = 0; i < (frame->width * frame->height); i++) {
-        // Move to the next row to force where the pixels are displayed
-        if ((i > 0) && ((i % frame->width) == 0)) {
-            writeTerminalBlock(channel, '\r');
-            writeTerminalBlock(channel, '\n');
-        }
+    // Every kernel does the same float operations in the same order as
+    // projectTriangle() and pointToScreen(), so the results match bit for bit
+    // as long as the compiler does not fuse the multiplies and adds. With
+    // RENDER_ENGINE_FAST_MATH the horizontal distance is left to the caller
+#if defined(RENDER_SIMD_AVX)
+    __m256 cameraX = _mm256_set1_ps(location->x);
+    __m256 cameraY = _mm256_set1_ps(location->y);
+    __m256 cameraZ = _mm256_set1_ps(location->z);
+    __m256 directionX = _mm256_set1_ps(direction->x);
+    __m256 directionY = _mm256_set1_ps(direction->y);
+    __m256 directionZ = _mm256_set1_ps(direction->z);
+    for (i = 0; i < RENDER_VERTEX_BATCH; i += 8) {
+        __m256 x = _mm256_sub_ps(_mm256_loadu_ps(vertices->x + first + i), cameraX);
+        __m256 y = _mm256_sub_ps(_mm256_loadu_ps(vertices->y + first + i), cameraY);
+        __m256 z = _mm256_sub_ps(_mm256_loadu_ps(vertices->z + first + i), cameraZ);
+        __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, directionX),
+                _mm256_mul_ps(y, directionY)), _mm256_mul_ps(z, directionZ));
+        _mm256_storeu_ps(dx + i, x);
+        _mm256_storeu_ps(dy + i, y);
+        _mm256_storeu_ps(dz + i, z);
+#ifndef RENDER_ENGINE_FAST_MATH
+        __m256 flat = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+        _mm256_storeu_pd(horizontal + i,
+                _mm256_sqrt_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(flat))));
+        _mm256_storeu_pd(horizontal + i + 4,
+                _mm256_sqrt_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(flat, 1))));
+#endif
         
-        // Increase speed by only changing the selected color when needed
-        if (lastColor != frame->buffer[i]) {
-            // Change the current color
-            lastColor = frame->buffer[i];
-            changeTerminalColor(channel, frame->buffer[i]);
-        }
+        // Not less or equal, so a NaN counts as in front like it does below
+        front |= (uint32_t) _mm256_movemask_ps(_mm256_cmp_ps(dot,
+                _mm256_setzero_ps(), _CMP_NLE_UQ)) << i;
+    }
+#elif defined(RENDER_SIMD_SSE2)
+    __m128 cameraX = _mm_set1_ps(location->x);
+    __m128 cameraY = _mm_set1_ps(location->y);
+    __m128 cameraZ = _mm_set1_ps(location->z);
+    __m128 directionX = _mm_set1_ps(direction->x);
+    __m128 directionY = _mm_set1_ps(direction->y);
+    __m128 directionZ = _mm_set1_ps(direction->z);
+    for (i = 0; i < RENDER_VERTEX_BATCH; i += 4) {
+        __m128 x = _mm_sub_ps(_mm_loadu_ps(vertices->x + first + i), cameraX);
+        __m128 y = _mm_sub_ps(_mm_loadu_ps(vertices->y + first + i), cameraY);
+        __m128 z = _mm_sub_ps(_mm_loadu_ps(vertices->z + first + i), cameraZ);
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, directionX),
+                _mm_mul_ps(y, directionY)), _mm_mul_ps(z, directionZ));
+        _mm_storeu_ps(dx + i, x);
+        _mm_storeu_ps(dy + i, y);
+        _mm_storeu_ps(dz + i, z);
+#ifndef RENDER_ENGINE_FAST_MATH
+        __m128 flat = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+        _mm_storeu_pd(horizontal + i, _mm_sqrt_pd(_mm_cvtps_pd(flat)));
+        _mm_storeu_pd(horizontal + i + 2,
+                _mm_sqrt_pd(_mm_cvtps_pd(_mm_movehl_ps(flat, flat))));
+#endif
+        
+        // Not less or equal, so a NaN counts as in front like it does below
+        front |= (uint32_t) _mm_movemask_ps(_mm_cmpnle_ps(dot, _mm_setzero_ps())) << i;
+    }
+#elif defined(RENDER_SIMD_NEON)
+    const uint32_t laneBits[4] = {1, 2, 4, 8};
+    uint32x4_t bits = vld1q_u32(laneBits);
+    float32x4_t cameraX = vdupq_n_f32(location->x);
+    float32x4_t cameraY = vdupq_n_f32(location->y);
+    float32x4_t cameraZ = vdupq_n_f32(location->z);
+    float32x4_t directionX = vdupq_n_f32(direction->x);
+    float32x4_t directionY = vdupq_n_f32(direction->y);
+    float32x4_t directionZ = vdupq_n_f32(direction->z);
+    for (i = 0; i < RENDER_VERTEX_BATCH; i += 4) {
+        float32x4_t x = vsubq_f32(vld1q_f32(vertices->x + first + i), cameraX);
+        float32x4_t y = vsubq_f32(vld1q_f32(vertices->y + first + i), cameraY);
+        float32x4_t z = vsubq_f32(vld1q_f32(vertices->z + first + i), cameraZ);
+        float32x4_t dot = vaddq_f32(vaddq_f32(vmulq_f32(x, directionX),
+                vmulq_f32(y, directionY)), vmulq_f32(z, directionZ));
+        vst1q_f32(dx + i, x);
+        vst1q_f32(dy + i, y);
+        vst1q_f32(dz + i, z);
+#ifndef RENDER_ENGINE_FAST_MATH
+        float32x4_t flat = vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y));
+        vst1q_f64(horizontal + i, vsqrtq_f64(vcvt_f64_f32(vget_low_f32(flat))));
+        vst1q_f64(horizontal + i + 2, vsqrtq_f64(vcvt_high_f64_f32(flat)));
+#endif
         
-        // Output a color block
-        writeTerminalBlock(channel, ' ');
+        // Clear the lanes that are behind, so a NaN counts as in front
+        front |= vaddvq_u32(vbicq_u32(bits, vcleq_f32(dot, vdupq_n_f32(0)))) << i;
+    }
+#else
+    rounding_t dot;
+    for (i = 0; i < RENDER_VERTEX_BATCH; i++) {
+        dx[i] = vertices->x[first + i] - location->x;
+        dy[i] = vertices->y[first + i] - location->y;
+        dz[i] = vertices->z[first + i] - location->z;
+        dot = (dx[i] * direction->x) + (dy[i] * direction->y) + (dz[i] * direction->z);
+#ifndef RENDER_ENGINE_FAST_MATH
+        horizontal[i] = sqrt((dx[i] * dx[i]) + (dy[i] * dy[i]));
+#endif
+        if (!(dot <= 0)) {
+            front |= (uint32_t) 1 << i;
+        }
     }
+#endif
+    
+    return front;
 }
 
-// Rendering helper functions
-point_t pointToScreen(vector_t delta,
-        rounding_t camHAngle, rounding_t camVAngle,
-        rounding_t angleHPixel, rounding_t angleVPixel,
-        uint8_t halfWidth, uint8_t halfHeight) {
+#ifndef RENDER_ENGINE_FAST_MATH
+point_t pointToScreen(render_context_t *context, vector_t delta, double horizontal) {
     rounding_t angleHorizontal, angleVertical;
     point_t screen;
     
@@ -369,70 +1779,226 @@ point_t pointToScreen(vector_t delta,
     if ((delta.x == 0) && (delta.y == 0)) {
         angleHorizontal = 0;
     } else {
-        angleHorizontal = atan2(delta.y, delta.x) - camHAngle;
+        angleHorizontal = atan2(delta.y, delta.x) - context->cameraHorizontalAngle;
     }
     if (angleHorizontal <= -M_PI) {
         angleHorizontal += 2 * M_PI;
     } else if (angleHorizontal > M_PI) {
         angleHorizontal -= 2 * M_PI;
     }
-    screen.x = halfWidth - (angleHorizontal / angleHPixel);
+    screen.x = context->halfWidth - (angleHorizontal / context->anglePerPixelHorizontal);
     
     // Vertical position onscreen
     if ((delta.x == 0) && (delta.y == 0) && (delta.z == 0)) {
         angleVertical = 0;
     } else {
-        angleVertical = atan2(delta.z, sqrt((delta.x * delta.x) +
-                (delta.y * delta.y))) - camVAngle;
+        angleVertical = atan2(delta.z, horizontal) - context->cameraVerticalAngle;
     }
-    screen.y = halfHeight - (angleVertical / angleVPixel);
+    screen.y = context->halfHeight - (angleVertical / context->anglePerPixelVertical);
     
     return screen;
 }
+#else
+point_t pointToScreen(render_context_t *context, vector_t delta, double horizontal) {
+    const rounding_t pi = M_PI;
+    rounding_t angleHorizontal, angleVertical;
+    point_t screen;
+    
+    // Same steps as the exact version. Each branch is replaced by multiplying
+    // with the result of its test, so the compiler has no branches to keep
+    // and loops over corners vectorize
+    angleHorizontal = Render_Engine_FastAtan2(delta.y, delta.x) -
+            context->cameraHorizontalAngle;
+    angleHorizontal *= (rounding_t) ((delta.x != 0) | (delta.y != 0));
+    angleHorizontal += 2 * pi * ((rounding_t) (angleHorizontal <= -pi) -
+            (rounding_t) (angleHorizontal > pi));
+    screen.x = context->halfWidth - (angleHorizontal / context->anglePerPixelHorizontal);
+    
+    angleVertical = Render_Engine_FastAtan2(delta.z, horizontal) -
+            context->cameraVerticalAngle;
+    angleVertical *= (rounding_t) ((delta.x != 0) | (delta.y != 0) | (delta.z != 0));
+    screen.y = context->halfHeight - (angleVertical / context->anglePerPixelVertical);
+    
+    return screen;
+}
+#endif
+
+inline rounding_t Render_Engine_FastAtan2(rounding_t y, rounding_t x) {
+    rounding_t absX = fabsf(x);
+    rounding_t absY = fabsf(y);
+    rounding_t big = (absX > absY) ? absX : absY;
+    rounding_t small = (absX > absY) ? absY : absX;
+    rounding_t ratio = small / (big + FLT_MIN);
+    rounding_t square = ratio * ratio;
+    rounding_t angle;
+    
+    // atan() of a ratio between 0 and 1
+    angle = ratio * (0.99997726f + (square * (-0.33262347f + (square *
+            (0.19354346f + (square * (-0.11643287f + (square *
+            (0.05265332f + (square * -0.01172120f))))))))));
+    
+    // Fold the angle out to the octant and then the half of the point without
+    // branching, copysignf() flips the angle where it has to be subtracted
+    angle = ((rounding_t) (M_PI / 2) * (absY > absX)) + copysignf(angle, absX - absY);
+    angle = ((rounding_t) M_PI * (x < 0)) + copysignf(angle, x);
+    return copysignf(angle, y);
+}
+
+inline rounding_t Render_Engine_FastSqrt(rounding_t value) {
+    union {
+        float value;
+        uint32_t bits;
+    } estimate = {value};
+    
+    // Halving the exponent bits gives the reciprocal square root to within a
+    // few percent, two Newton steps bring it to a few parts per million
+    estimate.bits = 0x5f375a86 - (estimate.bits >> 1);
+    estimate.value *= 1.5f - (0.5f * value * estimate.value * estimate.value);
+    estimate.value *= 1.5f - (0.5f * value * estimate.value * estimate.value);
+    return value * estimate.value;
+}
 
 rounding_t dotProduct(vector_t a, vector_t b) {
     return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
 }
 
+vector_t triangleCenter(triangle_t *triangle) {
+    vector_t center = {(triangle->p1.x + triangle->p2.x + triangle->p3.x) / 3,
+            (triangle->p1.y + triangle->p2.y + triangle->p3.y) / 3,
+            (triangle->p1.z + triangle->p2.z + triangle->p3.z) / 3};
+    
+    return center;
+}
+
+rounding_t distanceToPoint(vector_t point, vector_t location) {
+    // Squared distance is enough for sorting
+    return ((point.x - location.x) * (point.x - location.x)) +
+            ((point.y - location.y) * (point.y - location.y)) +
+            ((point.z - location.z) * (point.z - location.z));
+}
+
+rounding_t distanceToTriangle(triangle_t *triangle, vector_t location) {
+    return distanceToPoint(triangleCenter(triangle), location);
+}
+
 int compareTriangles(const void* a, const void* b) {
-    triangle_t triA = *((triangle_t *) a);
-    triangle_t triB = *((triangle_t *) b);
-    vector_t triACenter = {(triA.p1.x + triA.p2.x + triA.p3.x) / 3,
-            (triA.p1.y + triA.p2.y + triA.p3.y) / 3,
-            (triA.p1.z + triA.p2.z + triA.p3.z) / 3};
-    vector_t triBCenter = {(triB.p1.x + triB.p2.x + triB.p3.x) / 3,
-            (triB.p1.y + triB.p2.y + triB.p3.y) / 3,
-            (triB.p1.z + triB.p2.z + triB.p3.z) / 3};
-    float distA = ((triACenter.x - compareCamera.location.x) * (triACenter.x - compareCamera.location.x)) +
-            ((triACenter.y - compareCamera.location.y) * (triACenter.y - compareCamera.location.y)) +
-            ((triACenter.z - compareCamera.location.z) * (triACenter.z - compareCamera.location.z));
-    float distB = ((triBCenter.x - compareCamera.location.x) * (triBCenter.x - compareCamera.location.x)) +
-            ((triBCenter.y - compareCamera.location.y) * (triBCenter.y - compareCamera.location.y)) +
-            ((triBCenter.z - compareCamera.location.z) * (triBCenter.z - compareCamera.location.z));
-    
-    if (distA == distB) {
-        return 0;
-    } else if (distA < distB) {
+    render_order_t *orderA = (render_order_t *) a;
+    render_order_t *orderB = (render_order_t *) b;
+    
+    // Farthest triangles are painted first, ties keep the world order so
+    // every qsort implementation gives the same picture
+    if (orderA->distance < orderB->distance) {
         return 1;
-    } else {
+    } else if (orderA->distance > orderB->distance) {
         return -1;
+    } else if (orderA->index < orderB->index) {
+        return -1;
+    } else if (orderA->index > orderB->index) {
+        return 1;
+    } else {
+        return 0;
     }
 }
 
-void paintPixel(framebuffer_t* frame, uint16_t x, uint16_t y, uint8_t color) {
-    if ((x < frame->width) && (y < frame->height)) {
-        frame->buffer[x + (y * frame->width)] = color;
+uint32_t encodeNumber(uint8_t *out, uint32_t number) {
+    char digits[10];
+    uint8_t numDigits = 0;
+    uint32_t length;
+    
+    // Find the digits from the ones up, the terminal wants them the other way
+    do {
+        digits[numDigits++] = (number % 10) + '0';
+        number /= 10;
+    } while (number > 0);
+    
+    length = numDigits;
+    while (numDigits > 0) {
+        *out++ = digits[--numDigits];
     }
+    return length;
 }
 
-void paintPixelf(framebuffer_t* frame, rounding_t x, rounding_t y, uint8_t color) {
+int compareCorners(const void *a, const void *b) {
+    const render_scene_corner_t *cornerA = a;
+    const render_scene_corner_t *cornerB = b;
+    int result = memcmp(&cornerA->point, &cornerB->point, sizeof(vector_t));
+    
+    // Any order that groups equal corners will do, ties keep the corner order
+    // so every qsort implementation numbers the corners the same
+    if (result != 0) {
+        return result;
+    }
+    return (cornerA->corner > cornerB->corner) - (cornerA->corner < cornerB->corner);
+}
+
+RENDER_INLINE void paintColumn(render_area_t area, rounding_t x,
+        rounding_t topY, rounding_t bottomY, uint8_t color) {
+    rounding_t y = topY;
+    uint32_t row, numRows, maxRows;
+    uint8_t *pixel;
+    
+    // Skip columns and rows that are outside the clip area, stepping over
+    // whole pixels keeps the same sample points as painting every row
+    if ((x < area.left) || (x >= area.right)) {
+        return;
+    }
+    if (y >= area.bottom) {
+        y -= floor(y) - area.bottom + 1;
+    }
+    
+    // Paint from y down one pixel at a time while above bottomY and inside
+    // the clip area. Every y - n down to the top of the area is exact, so the
+    // number of rows can be worked out first and the comparison of the last
+    // one repeated to settle any rounding of y - bottomY
+    if ((y > bottomY) && (y >= area.top)) {
+        row = y;
+        maxRows = row - area.top + 1;
+        numRows = maxRows;
+        if ((double) y - bottomY < maxRows) {
+            numRows = ceil((double) y - bottomY);
+        }
+        while ((numRows > 1) && !((y - (rounding_t) (numRows - 1)) > bottomY)) {
+            numRows--;
+        }
+        while ((numRows < maxRows) && ((y - (rounding_t) numRows) > bottomY)) {
+            numRows++;
+        }
+        
+        // Columns of a column layout frame are one run of memory
+        pixel = area.buffer + ((uint32_t) x * area.columnStep) +
+                ((row - numRows + 1) * area.rowStep);
+        if (area.rowStep == 1) {
+            memset(pixel, color, numRows);
+        } else {
+            while (numRows-- > 0) {
+                *pixel = color;
+                pixel += area.rowStep;
+            }
+        }
+    }
+    
+    // Catch one more paint
+    paintPixelf(area, x, bottomY, color);
+}
+
+RENDER_INLINE void paintPixel(render_area_t area, uint16_t x, uint16_t y, uint8_t color) {
+    // Only paint inside the clip area, which is never bigger than the frame
+    if ((x >= area.left) && (x < area.right) &&
+            (y >= area.top) && (y < area.bottom)) {
+        area.buffer[((uint32_t) x * area.columnStep) +
+                ((uint32_t) y * area.rowStep)] = color;
+    }
+}
+
+RENDER_INLINE void paintPixelf(render_area_t area, rounding_t x, rounding_t y, uint8_t color) {
     if ((x >= 0) && (y >= 0)) {
-        paintPixel(frame, (uint16_t) x, (uint16_t) y, color);
+        paintPixel(area, (uint16_t) x, (uint16_t) y, color);
     }
 }
 
+#ifndef RENDER_ENGINE_HOST
 // UART helper functions
-void changeTerminalCursorLocation(uint8_t channel, uint8_t x, uint8_t y) {
+void changeTerminalCursorLocation(uint8_t channel, uint16_t x, uint16_t y) {
     writeTerminalBlock(channel, '\e');
     writeTerminalBlock(channel, '[');
     writeTerminalNumber(channel, y + 1);
@@ -441,28 +2007,18 @@ void changeTerminalCursorLocation(uint8_t channel, uint8_t x, uint8_t y) {
     writeTerminalBlock(channel, 'H');
 }
 
-void writeTerminalNumber(uint8_t channel, uint8_t number) {
-    uint8_t atDigits = 0;
-    
-    // Look for hundreds
-    uint8_t hundreds = (number / 100) % 10;
-    if (hundreds > 0) {
-        atDigits = 1;
-        writeTerminalBlock(channel, hundreds + '0');
-    }
+void writeTerminalNumber(uint8_t channel, uint32_t number) {
+    char digits[10];
+    uint8_t numDigits = 0;
     
-    // Look for tens
-    uint8_t tens = (number / 10) % 10;
-    if ((tens > 0) || atDigits) {
-        atDigits = 1;
-        writeTerminalBlock(channel, tens + '0');
-    }
+    // Find the digits from the ones up, the terminal wants them the other way
+    do {
+        digits[numDigits++] = (number % 10) + '0';
+        number /= 10;
+    } while (number > 0);
     
-    // Look for ones
-    uint8_t ones = number % 10;
-    if ((ones > 0) || atDigits) {
-        atDigits = 1;
-        writeTerminalBlock(channel, ones + '0');
+    while (numDigits > 0) {
+        writeTerminalBlock(channel, digits[--numDigits]);
     }
 }
 
@@ -479,3 +2035,34 @@ void writeTerminalBlock(uint8_t channel, uint8_t data) {
     while (!hal_UART_SpaceAvailable(channel));
     hal_UART_TxByte(channel, data);
 }
+
+RENDER_INLINE void writeTerminalFrame(uint8_t channel, uint8_t *buffer,
+        uint16_t width, uint16_t height, uint16_t columnStep, uint16_t rowStep) {
+    uint8_t *pixel;
+    uint16_t x, y;
+    uint8_t lastColor = 0;
+    
+    // Access the UART through the HAL directly to get around the buffer
+    for (y = 0; y < height; y++) {
+        // Move to the next row to force where the pixels are displayed
+        if (y > 0) {
+            writeTerminalBlock(channel, '\r');
+            writeTerminalBlock(channel, '\n');
+        }
+        
+        pixel = buffer + ((uint32_t) y * rowStep);
+        for (x = 0; x < width; x++) {
+            // Increase speed by only changing the selected color when needed
+            if (lastColor != *pixel) {
+                // Change the current color
+                lastColor = *pixel;
+                changeTerminalColor(channel, lastColor);
+            }
+            
+            // Output a color block
+            writeTerminalBlock(channel, ' ');
+            pixel += columnStep;
+        }
+    }
+}
+#endif
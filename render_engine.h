@@ -14,6 +14,78 @@
  * - Render_Engine_RenderFrame() to populate a framebuffer with the image
  * - Render_Engine_DisplayFrame() to send a framebuffer out over a UART channel
  * 
+ * When rendering must not hold up other tasks for too long, the same frame can
+ * be rendered a few triangles at a time:
+ * - Render_Engine_BeginFrame() to clear the framebuffer and sort the triangles
+ * - Render_Engine_StepFrame() as often as needed until it returns 1
+ * 
+ * Rendering only needs the C library. Define RENDER_ENGINE_HOST to leave out
+ * the UART output so the engine can be used by tools running on a PC.
+ * Render_Engine_RenderFrame() does not use any global state, so separate
+ * frames may be rendered on separate threads.
+ * 
+ * Defining RENDER_ENGINE_THREADS as well adds Render_Engine_RenderFrameParallel()
+ * to split one large frame into tiles that are painted by a pool of threads.
+ * Many small frames, like those of many players, are better rendered whole and
+ * side by side by render workers (render_workers_t): each worker takes frames
+ * from its own queue, steals from the others when it runs dry, and keeps the
+ * buffers it sorts and projects into (render_scratch_t) from frame to frame
+ * instead of putting them on its stack.
+ * 
+ * Frames render faster on processors with vector units when the world has a
+ * vertex store (Render_Engine_LoadVertices()), Render_Engine_RenderFrame() then
+ * projects the corners in batches first.
+ * 
+ * A world that is rendered many times can be prepared once as a scene with
+ * Render_Engine_LoadScene(). Corners shared by several triangles are then
+ * projected once per frame, and triangles that are behind the camera or past
+ * either side of the view are left out before sorting. The picture is the
+ * same.
+ * 
+ * Worlds built from a few shapes repeated many times, like the tiles of a maze,
+ * can be described with Render_Engine_LoadInstances() instead of a triangle
+ * array. Each instance places one template mesh at an offset, so the world
+ * only needs memory for each placement and not for every triangle. Meshes
+ * whose corners lie on a grid can be stored packed (render_packed_triangle_t)
+ * in a quarter of the memory, the engine unpacks a triangle when it needs it.
+ * 
+ * Defining RENDER_ENGINE_FAST_MATH replaces the atan2() and sqrt() calls of the
+ * projection with Render_Engine_FastAtan2() and Render_Engine_FastSqrt(). Corners
+ * may move by a small fraction of a pixel, so a few pixels on triangle edges can
+ * change, but a batch of corners no longer needs any C library calls and can
+ * be vectorized by the compiler.
+ * 
+ * When every frame has the same size, define RENDER_ENGINE_FIXED_WIDTH and
+ * RENDER_ENGINE_FIXED_HEIGHT to that size (80 and 24 for the maze game). A
+ * second copy of the rasterizer and of the terminal output is then built with
+ * the row length and frame bounds as constants, and used for every frame of
+ * that size. Frames of any other size still use the generic code.
+ * 
+ * The rasterizer paints one column of pixels at a time. A framebuffer with
+ * the RenderLayoutColumns layout keeps each column together in memory so a
+ * column is painted with one memset(), which is faster for large frames.
+ * Render_Engine_DisplayFrame() takes either layout, and
+ * Render_Engine_TransposeFrame() turns a column frame into rows for other uses.
+ * Render_Engine_EncodeFrame() writes the bytes Render_Engine_DisplayFrame()
+ * would send into a buffer instead, for frames sent another way, like over a
+ * socket by a host program.
+ * 
+ * Things that move, like doors or the avatars of other players, are kept out
+ * of the triangles of the world in a fixed pool of objects
+ * (render_object_pool_t). The world and everything loaded from it, the
+ * instances, vertex store and scene, stay as they are when objects are added,
+ * moved or removed. The objects are sorted on their own each frame and painted
+ * in turn with the world, farthest first, so they cost time in proportion to
+ * their own triangles only:
+ * - Render_Engine_ObjectPoolInit() to give a world an empty pool
+ * - Render_Engine_AddObject() and Render_Engine_RemoveObject() between frames
+ * 
+ * A camera can limit how far it sees. Triangles whose middle is farther than
+ * camera->farDistance are left out before sorting, so the work of a frame
+ * stays bounded however large the world is. Triangles in the band between
+ * camera->fogDistance and the far distance are painted in camera->fogColor,
+ * so the walls fade out instead of ending suddenly.
+ * 
  * @section Example
  * 
  * The following code can be used to display a pyramid onscreen. The camera
@@ -43,6 +115,7 @@ int main() {
     // Test render engine
     world_t worldA;
     camera_t cam;
+    Render_Engine_InitCamera(&cam);
     cam.fovHorizontal = 100;
     cam.fovVertical = 75;
     cam.location.x = 0;
@@ -55,9 +128,11 @@ int main() {
     framebuffer_t buf;
     buf.width = 80;
     buf.height = 24;
+    buf.layout = RenderLayoutRows;
     uint8_t bufAlloc[buf.width * buf.height];
     buf.buffer = bufAlloc;
     
+    Render_Engine_InitWorld(&worldA);
     worldA.numTriangles = 4;
     worldA.backgroundColor = Blue;
     vector_t backTop = {0, 0, 3};
@@ -111,6 +186,9 @@ int main() {
 #define RENDER_ENGINE_H
 
 #include <stdint.h>
+#ifdef RENDER_ENGINE_THREADS
+#include <pthread.h>
+#endif
 
 // Precision of the engine
 typedef float rounding_t;
@@ -127,6 +205,12 @@ enum pixel_color {
     White
 };
 
+// Order of the pixels in a framebuffer
+enum render_layout {
+    RenderLayoutRows, ///< pixel (x, y) is at x + (y * width)
+    RenderLayoutColumns ///< pixel (x, y) is at y + (x * height)
+};
+
 typedef struct point {
     rounding_t x;
     rounding_t y;
@@ -138,12 +222,19 @@ typedef struct vector {
     rounding_t z;
 } vector_t;
 
+/**
+ * Point of view of a frame. Fields that are not used, like farDistance and
+ * fogDistance, must be 0, Render_Engine_InitCamera() sets every field to 0.
+ */
 typedef struct camera {
     uint16_t status;
     vector_t location;
     vector_t rotation;
     int fovHorizontal;
     int fovVertical;
+    rounding_t farDistance; ///< triangles with their middle farther away are left out, 0 for no limit
+    rounding_t fogDistance; ///< triangles with their middle farther away are painted fogColor, 0 for no fog
+    uint8_t fogColor;
 } camera_t;
 
 typedef struct triangle {
@@ -153,24 +244,195 @@ typedef struct triangle {
     uint8_t color;
 } triangle_t;
 
+/**
+ * Triangle with corners on a grid, each corner value is a number of
+ * world->gridScale steps. Unpacks to exactly the triangle_t with the corners
+ * multiplied out as long as those products are exact floats, which is the
+ * case for the small whole numbers of a maze.
+ */
+typedef struct render_packed_triangle {
+    int8_t p1[3];
+    int8_t p2[3];
+    int8_t p3[3];
+    uint8_t color;
+} render_packed_triangle_t;
+
+/**
+ * Template triangles shared by every instance that places them, corners are
+ * relative to the offset of the instance.
+ */
+typedef struct render_mesh {
+    const triangle_t *triangles; ///< 0 when the mesh is packed
+    uint16_t numTriangles;
+    const render_packed_triangle_t *packed; ///< used when triangles is 0
+} render_mesh_t;
+
+/**
+ * One placement of a mesh in the world. Triangles of an instance follow each
+ * other in the world, in the same order as in the mesh.
+ */
+typedef struct render_instance {
+    vector_t offset; ///< added to every corner of the mesh
+    uint32_t first; ///< world index of the first triangle, set by Render_Engine_LoadInstances()
+    uint16_t mesh; ///< entry of world->meshes to place
+    uint8_t color; ///< replaces the colors of the mesh, 0 keeps them
+} render_instance_t;
+
+// Corners handled together by Render_Engine_ProjectVertices(), a multiple of
+// 3 (whole triangles) and of 8 (one AVX register of corners)
+#define RENDER_VERTEX_BATCH 24
+
+// Corners to allocate for a world, rounded up to whole batches
+#define RENDER_VERTEX_STRIDE(numTriangles) \
+        (((((numTriangles) * 3) + RENDER_VERTEX_BATCH - 1) / RENDER_VERTEX_BATCH) * \
+        RENDER_VERTEX_BATCH)
+
+/**
+ * Corners of every triangle split into one array per axis, corner k of
+ * triangle i is entry (3 * i) + k. Loaded by Render_Engine_LoadVertices().
+ */
+typedef struct render_vertices {
+    rounding_t *x;
+    rounding_t *y;
+    rounding_t *z;
+    uint32_t count; ///< corners in use, 3 * numTriangles
+    uint32_t stride; ///< corners allocated, RENDER_VERTEX_STRIDE(numTriangles)
+} render_vertices_t;
+
+// Bytes of storage Render_Engine_LoadScene() needs for a world
+#define RENDER_SCENE_STORAGE(numTriangles) \
+        ((3 * RENDER_VERTEX_STRIDE(numTriangles) * sizeof(rounding_t)) + \
+        ((numTriangles) * (sizeof(vector_t) + sizeof(rounding_t) + \
+        (3 * sizeof(uint32_t)))))
+
+/**
+ * World prepared by Render_Engine_LoadScene() for rendering many frames.
+ */
+typedef struct render_scene {
+    render_vertices_t vertices; ///< every distinct corner once
+    uint32_t *corners; ///< 3 entries of vertices for each triangle
+    vector_t *centers; ///< middle of each triangle, sorts the triangles
+    rounding_t *radii; ///< distance from the middle to the farthest corner
+} render_scene_t;
+
+// Mesh of the unused slots of an object pool
+#define RENDER_NO_MESH UINT16_MAX
+
+/**
+ * Fixed number of instances that are not part of the world's triangles. Each
+ * object in use places a mesh with at most maxTriangles triangles, the first
+ * field of the objects is not used.
+ */
+typedef struct render_object_pool {
+    const render_mesh_t *meshes; ///< templates placed by the objects
+    render_instance_t *objects; ///< maxObjects slots, unused ones have mesh RENDER_NO_MESH
+    uint16_t maxObjects;
+    uint16_t numObjects; ///< slots in use
+    uint16_t maxTriangles; ///< most triangles of a mesh placed by one object
+} render_object_pool_t;
+
+/**
+ * Everything drawn in a frame. Fields that are not used, like vertices, scene,
+ * instances and objects, must be 0, Render_Engine_InitWorld() sets every field
+ * to 0.
+ */
 typedef struct world {
     uint8_t backgroundColor;
-    uint16_t numTriangles;
+    uint32_t numTriangles;
     triangle_t *triangles;
+    render_vertices_t *vertices; ///< optional copy of the corners, 0 if unused
+    render_scene_t *scene; ///< optional prepared copy of the world, 0 if unused
+    const render_mesh_t *meshes; ///< templates placed by instances
+    const render_instance_t *instances; ///< used instead of triangles, 0 if unused
+    uint32_t numInstances;
+    rounding_t gridScale; ///< world units per step of packed mesh corners
+    render_object_pool_t *objects; ///< optional moving objects, 0 if unused
 } world_t;
 
+// Entries of the order array Render_Engine_BeginFrame() needs for a world
+#define RENDER_ORDER_SIZE(world) ((world)->numTriangles + \
+        (((world)->objects != 0) ? \
+        ((uint32_t) (world)->objects->maxObjects * (world)->objects->maxTriangles) : 0))
+
+typedef struct render_order {
+    rounding_t distance;
+    uint32_t index;
+} render_order_t;
+
 typedef struct framebuffer {
     uint16_t width;
     uint16_t height;
     uint8_t *buffer;
+    uint8_t layout; ///< enum render_layout, 0 is RenderLayoutRows
 } framebuffer_t;
 
+/**
+ * Part of a framebuffer the rasterizer may paint. Taken from the render
+ * context once per triangle so the pixel loops do not reload it after every
+ * write.
+ */
+typedef struct render_area {
+    uint8_t *buffer;
+    uint16_t columnStep; ///< distance in buffer from one column to the next
+    uint16_t rowStep; ///< distance in buffer from one row to the next
+    uint16_t left; ///< first column that may be painted
+    uint16_t top; ///< first row that may be painted
+    uint16_t right; ///< column after the last one that may be painted
+    uint16_t bottom; ///< row after the last one that may be painted
+} render_area_t;
+
+typedef struct render_context {
+    world_t *world;
+    camera_t camera;
+    framebuffer_t *frame;
+    render_order_t *order;
+    uint32_t next; ///< next entry of order to paint
+    uint32_t orderCount; ///< entries of order, a scene leaves some triangles out
+    uint32_t fogCount; ///< entries at the start of order painted in the fog color
+    render_order_t *objectOrder; ///< triangles of the objects, sorted apart from the world
+    uint32_t objectNext; ///< next entry of objectOrder to paint
+    uint32_t objectCount; ///< entries of objectOrder
+    uint32_t objectFogCount; ///< entries at the start of objectOrder painted in the fog color
+    uint16_t clipLeft; ///< first column that may be painted
+    uint16_t clipTop; ///< first row that may be painted
+    uint16_t clipRight; ///< column after the last one that may be painted
+    uint16_t clipBottom; ///< row after the last one that may be painted
+    uint16_t halfWidth;
+    uint16_t halfHeight;
+    rounding_t anglePerPixelHorizontal;
+    rounding_t anglePerPixelVertical;
+    rounding_t cameraHorizontalAngle;
+    rounding_t cameraVerticalAngle;
+    vector_t cameraDirection;
+    point_t *screen; ///< corners projected up front, 0 to project while painting
+    uint8_t *visible; ///< 1 for triangles with a corner in front of the camera
+} render_context_t;
+
+/** @brief Set up an empty world
+ * 
+ * Sets every field to 0, so the optional vertices, scene, instances and objects
+ * are unused. Fill in the triangles or instances after.
+ * 
+ * @param world World to set up.
+ */
+void Render_Engine_InitWorld(world_t *world);
+
+/** @brief Set up a camera without a far distance or fog
+ * 
+ * Sets every field to 0. Fill in the location, rotation and fields of view
+ * after.
+ * 
+ * @param camera Camera to set up.
+ */
+void Render_Engine_InitCamera(camera_t *camera);
+
 /** @brief Render a frame
  * 
  * Renders a frame of data based on a list of triangles in the world object.
  * Make sure the array in the framebuffer has been created as this will not
  * create the needed array for you. This method is blocking during the rendering
- * process.
+ * process. The sort order is kept on the stack, for scenes of many thousands of
+ * triangles call Render_Engine_BeginFrame() with an order array on the heap.
  * 
  * @param world World data that contains the list of triangles in 3D space to
  * render.
@@ -181,18 +443,437 @@ typedef struct framebuffer {
  */
 void Render_Engine_RenderFrame(world_t *world, camera_t *camera, framebuffer_t *framebuffer);
 
+/** @brief Start rendering a frame in steps
+ * 
+ * Fills the framebuffer with the background color and sorts the triangles.
+ * Nothing is painted until Render_Engine_StepFrame() is called. The camera is
+ * copied, but the world and framebuffer must not change until the frame is
+ * finished.
+ * 
+ * @param context Render state to set up, holds everything needed to resume.
+ * @param world World data that contains the list of triangles to render.
+ * @param camera Camera data that contains the location and direction of the
+ * camera.
+ * @param framebuffer Framebuffer to render into.
+ * @param order Array of RENDER_ORDER_SIZE(world) entries used for sorting,
+ * must stay valid until the frame is finished.
+ */
+void Render_Engine_BeginFrame(render_context_t *context, world_t *world,
+        camera_t *camera, framebuffer_t *framebuffer, render_order_t *order);
+
+/** @brief Continue rendering a frame
+ * 
+ * @param context Render state from Render_Engine_BeginFrame().
+ * @param numTriangles Most triangles to paint before returning.
+ * @return 1 if the frame is finished, 0 if there is more to paint.
+ */
+uint8_t Render_Engine_StepFrame(render_context_t *context, uint32_t numTriangles);
+
+/** @brief Finish rendering a frame
+ * 
+ * Paints everything left of a frame started with Render_Engine_BeginFrame().
+ * This method is blocking.
+ * 
+ * @param context Render state from Render_Engine_BeginFrame().
+ */
+void Render_Engine_FinishFrame(render_context_t *context);
+
+/** @brief Build a world from instances of template meshes
+ * 
+ * Numbers the triangles of the instances one after the other, sets
+ * world->numTriangles to the total and points the world at the instances.
+ * world->triangles is no longer used. Set world->gridScale as well when any of
+ * the meshes are packed. Must be called again whenever instances are added,
+ * removed or placed on another mesh. Offsets and colors may be changed in
+ * between, unless a vertex store or scene was loaded from them.
+ * 
+ * Instances numbered ahead of time, like const ones kept in flash, need no
+ * call: point world->meshes and world->instances at them and set
+ * world->numInstances and world->numTriangles.
+ * 
+ * @param world World to set up.
+ * @param meshes Array of the template meshes.
+ * @param instances Array of numInstances placements.
+ * @param numInstances Number of instances in the world.
+ */
+void Render_Engine_LoadInstances(world_t *world, const render_mesh_t *meshes,
+        render_instance_t *instances, uint32_t numInstances);
+
+/** @brief Set up an empty pool of moving objects
+ * 
+ * Marks every slot unused and points world->objects at the pool. The objects
+ * are painted with world->gridScale when their meshes are packed.
+ * 
+ * @param world World the objects move in.
+ * @param pool Pool to set up.
+ * @param meshes Array of the template meshes the objects may place.
+ * @param objects Array of maxObjects slots.
+ * @param maxObjects Number of objects that may be in use at once.
+ * @param maxTriangles Most triangles of a mesh placed by one object.
+ */
+void Render_Engine_ObjectPoolInit(world_t *world, render_object_pool_t *pool,
+        const render_mesh_t *meshes, render_instance_t *objects,
+        uint16_t maxObjects, uint16_t maxTriangles);
+
+/** @brief Place an object from the pool
+ * 
+ * Takes the first unused slot. The offset and color of the object may be
+ * changed through the returned pointer between frames.
+ * 
+ * @param pool Pool to take the object from.
+ * @param mesh Entry of pool->meshes to place.
+ * @param offset Added to every corner of the mesh.
+ * @param color Replaces the colors of the mesh, 0 keeps them.
+ * @return The object, 0 if the pool is full or the mesh has more than
+ * pool->maxTriangles triangles.
+ */
+render_instance_t *Render_Engine_AddObject(render_object_pool_t *pool, uint16_t mesh,
+        vector_t offset, uint8_t color);
+
+/** @brief Give an object back to the pool
+ * 
+ * Must not be called while a frame of the world is being rendered.
+ * 
+ * @param pool Pool the object was taken from.
+ * @param object Object from Render_Engine_AddObject().
+ */
+void Render_Engine_RemoveObject(render_object_pool_t *pool, render_instance_t *object);
+
+/** @brief Get one triangle of a world
+ * 
+ * Works for worlds made of a triangle array and of instances alike.
+ * 
+ * @param world World to read.
+ * @param index Triangle to get, less than world->numTriangles.
+ * @param triangle Filled with the corners and color of the triangle.
+ */
+void Render_Engine_GetTriangle(world_t *world, uint32_t index, triangle_t *triangle);
+
+/** @brief Copy the corners of a world into a vertex store
+ * 
+ * Splits the triangles of the world into x, y and z arrays and points
+ * world->vertices at the store. Must be called again whenever the triangles
+ * change.
+ * 
+ * @param world World to copy the triangles of.
+ * @param vertices Vertex store to fill.
+ * @param storage Block of 3 * RENDER_VERTEX_STRIDE(world->numTriangles)
+ * values to hold the arrays.
+ */
+void Render_Engine_LoadVertices(world_t *world, render_vertices_t *vertices,
+        rounding_t *storage);
+
+/** @brief Prepare a world for rendering many frames
+ * 
+ * Numbers the distinct corners of the triangles and works out the middle of
+ * every triangle and the size of a sphere around it, then points world->scene
+ * at the scene. Frames of the world are then sorted by the stored middles and
+ * leave out triangles that are behind the camera or wholly past either side
+ * of the view, which is tested on the spheres. Render_Engine_ProjectVertices()
+ * projects each distinct corner once. Must be called again whenever the
+ * triangles change.
+ * 
+ * @param world World to prepare.
+ * @param scene Scene to fill.
+ * @param storage Block of RENDER_SCENE_STORAGE(world->numTriangles) bytes,
+ * aligned for a rounding_t, to hold the scene.
+ */
+void Render_Engine_LoadScene(world_t *world, render_scene_t *scene, void *storage);
+
+/** @brief Project every corner of a frame at once
+ * 
+ * Works out the camera offset, the in front test and the horizontal distance
+ * of RENDER_VERTEX_BATCH corners at a time from world->vertices, or from the
+ * scene when world->scene is set, using AVX, SSE2 or NEON when the compiler
+ * targets them (define RENDER_ENGINE_NO_SIMD to turn them off). The frame is
+ * the same as when every triangle is projected while painting. Call after
+ * Render_Engine_BeginFrame() and before painting, only if world->vertices or
+ * world->scene is set.
+ * 
+ * @param context Render state from Render_Engine_BeginFrame().
+ * @param screen Array of world->vertices->stride points, or
+ * world->scene->vertices.stride with a scene, must stay valid until the frame
+ * is finished.
+ * @param visible Array of world->numTriangles entries, or
+ * world->scene->vertices.count with a scene, must stay valid until the frame
+ * is finished.
+ */
+void Render_Engine_ProjectVertices(render_context_t *context, point_t *screen,
+        uint8_t *visible);
+
+/** @brief Approximate atan2()
+ * 
+ * Odd polynomial of degree 11 on the ratio of the smaller to the larger of |x|
+ * and |y|, folded out to the full circle. The result is at most 2e-6 radians
+ * from atan2(), well under a thousandth of a pixel at the widths the engine
+ * supports. Has no branches or library calls, so loops over it vectorize.
+ * 
+ * @param y Y coordinate.
+ * @param x X coordinate.
+ * @return Angle of the point in radians from -pi to pi, 0 for the origin.
+ */
+rounding_t Render_Engine_FastAtan2(rounding_t y, rounding_t x);
+
+/** @brief Approximate sqrt()
+ * 
+ * Multiplies the value by its reciprocal square root, which starts from an
+ * estimate made on the bits of the float and is refined with two Newton steps.
+ * The result is within 5e-6 of sqrt() relative to the value. Has no branches
+ * or library calls, so loops over it vectorize.
+ * 
+ * @param value Value to take the square root of, must not be negative.
+ * @return Square root of the value.
+ */
+rounding_t Render_Engine_FastSqrt(rounding_t value);
+
+#ifdef RENDER_ENGINE_THREADS
+#define RENDER_TILE_WIDTH 32
+#define RENDER_TILE_HEIGHT 16
+
+typedef struct render_projected {
+    point_t p1;
+    point_t p2;
+    point_t p3;
+    uint8_t color;
+    uint16_t tileLeft; ///< first column of tiles the triangle touches
+    uint16_t tileTop; ///< first row of tiles the triangle touches
+    uint16_t tileRight; ///< last column of tiles the triangle touches
+    uint16_t tileBottom; ///< last row of tiles the triangle touches
+} render_projected_t;
+
+typedef struct render_pool {
+    pthread_t *threads;
+    uint8_t numThreads;
+    pthread_mutex_t lock;
+    pthread_cond_t start; ///< signaled when a frame is ready to paint
+    pthread_cond_t done; ///< signaled when a worker finishes its tiles
+    uint32_t generation; ///< frame number, tells workers there is new work
+    uint8_t busy; ///< workers still painting the current frame
+    uint8_t stop; ///< workers should exit
+    render_context_t context; ///< frame being painted
+    render_projected_t *projected; ///< visible triangles, farthest first
+    uint32_t projectedAllocated;
+    point_t *screen; ///< corners for Render_Engine_ProjectVertices()
+    uint8_t *visible; ///< triangles for Render_Engine_ProjectVertices()
+    uint32_t *tileStart; ///< first entry of tileTriangles for each tile
+    uint32_t *tileTriangles; ///< projected triangles in each tile
+    uint32_t tileTrianglesAllocated;
+    uint32_t tilesAllocated;
+    uint16_t tilesWide;
+    uint32_t numTiles;
+    uint32_t nextTile; ///< next tile a thread should paint
+} render_pool_t;
+
+/** @brief Start a pool of render threads
+ * 
+ * @param pool Pool to set up.
+ * @param numThreads Number of threads to start. The thread calling
+ * Render_Engine_RenderFrameParallel() paints tiles as well, so 0 is valid.
+ * @return 1 if every thread was started, 0 otherwise. On failure the threads
+ * already started are stopped and everything is freed, the pool must not be
+ * destroyed.
+ */
+uint8_t Render_Engine_PoolInit(render_pool_t *pool, uint8_t numThreads);
+
+/** @brief Stop a pool of render threads and free its memory
+ * 
+ * @param pool Pool to stop.
+ */
+void Render_Engine_PoolDestroy(render_pool_t *pool);
+
+/** @brief Render a frame with a pool of threads
+ * 
+ * Projects the sorted triangles once, sorts them into tiles of
+ * RENDER_TILE_WIDTH by RENDER_TILE_HEIGHT pixels and paints the tiles in
+ * parallel. Triangles keep their order inside each tile, so the framebuffer
+ * is exactly the same as with Render_Engine_RenderFrame(). This method is
+ * blocking until every tile is painted. If the pool cannot grow its buffers
+ * for the frame, it is rendered with Render_Engine_RenderFrame() instead.
+ * 
+ * @param world World data that contains the list of triangles to render.
+ * @param camera Camera data that contains the location and direction of the
+ * camera.
+ * @param framebuffer Framebuffer to render into.
+ * @param pool Threads to paint with.
+ */
+void Render_Engine_RenderFrameParallel(world_t *world, camera_t *camera,
+        framebuffer_t *framebuffer, render_pool_t *pool);
+
+/// Buffers a frame is sorted and projected into, kept between frames
+typedef struct render_scratch {
+    render_order_t *order; ///< sorted triangles
+    point_t *screen; ///< corners for Render_Engine_ProjectVertices()
+    uint8_t *visible; ///< triangles for Render_Engine_ProjectVertices()
+    uint32_t allocated; ///< entries of order the buffers are sized for
+} render_scratch_t;
+
+/// Frame for render workers to paint
+typedef struct render_job {
+    world_t *world; ///< must not change until the job is collected
+    camera_t camera; ///< copy of the camera, the caller's may move on
+    framebuffer_t frame; ///< not to be read until the job is collected
+    void *user; ///< data of the caller
+} render_job_t;
+
+typedef struct render_workers render_workers_t;
+
+typedef struct render_worker {
+    render_workers_t *workers;
+    pthread_t thread;
+    pthread_mutex_t lock; ///< guards the queue
+    render_job_t **queue; ///< ring of maxJobs entries
+    uint16_t head; ///< oldest job in the queue
+    uint16_t count; ///< jobs in the queue
+    render_scratch_t scratch;
+    uint32_t rendered; ///< jobs painted
+    uint32_t stolen; ///< jobs taken from the queue of another worker
+} render_worker_t;
+
+/// Called from a worker's thread each time it finishes a job
+typedef void (*render_notify_t)(void *data);
+
+struct render_workers {
+    render_worker_t *workers;
+    uint8_t numWorkers;
+    uint8_t nextWorker; ///< queue the next job goes to
+    uint16_t maxJobs; ///< most jobs submitted and not collected
+    pthread_mutex_t lock; ///< guards everything below
+    pthread_cond_t wake; ///< signaled when a job is queued
+    uint32_t queued; ///< jobs waiting in the queues
+    uint16_t inFlight; ///< jobs submitted and not collected
+    render_job_t **done; ///< ring of maxJobs finished jobs
+    uint16_t doneHead; ///< oldest finished job
+    uint16_t doneCount; ///< finished jobs not collected
+    uint8_t stop; ///< workers should exit
+    render_notify_t notify;
+    void *notifyData;
+};
+
+/** @brief Set up empty scratch buffers
+ * 
+ * @param scratch Buffers to set up, they are allocated by the first frame.
+ */
+void Render_Engine_ScratchInit(render_scratch_t *scratch);
+
+/** @brief Free scratch buffers
+ * 
+ * @param scratch Buffers to free.
+ */
+void Render_Engine_ScratchFree(render_scratch_t *scratch);
+
+/** @brief Render a frame with scratch buffers
+ * 
+ * The same as Render_Engine_RenderFrame(), but the order and projected
+ * corners go into the scratch buffers, which grow to fit the largest world
+ * rendered with them. A thread rendering many frames then needs no stack for
+ * them and keeps them warm in its cache. If the buffers cannot grow the frame
+ * is rendered with Render_Engine_RenderFrame() instead.
+ * 
+ * @param world World data that contains the list of triangles to render.
+ * @param camera Camera data that contains the location and direction of the
+ * camera.
+ * @param framebuffer Framebuffer to render into.
+ * @param scratch Buffers used by one thread at a time.
+ */
+void Render_Engine_RenderFrameScratch(world_t *world, camera_t *camera,
+        framebuffer_t *framebuffer, render_scratch_t *scratch);
+
+/** @brief Start render workers
+ * 
+ * Jobs are spread over the queues of the workers in turn. A worker paints the
+ * oldest job of its own queue, and when that is empty takes the oldest job of
+ * another queue, so a worker held up by a large frame does not hold up the
+ * frames queued behind it.
+ * 
+ * @param workers Workers to set up.
+ * @param numWorkers Number of threads to start, at least 1.
+ * @param maxJobs Most jobs submitted and not collected yet.
+ * @param notify Called after each job finishes, from the worker's thread, 0
+ * for none. Lets a caller waiting on something else, like sockets, wake up.
+ * @param data Passed to notify.
+ * @return 1 if every thread was started, 0 otherwise. On failure the workers
+ * already started are stopped and everything is freed, the workers must not be
+ * destroyed.
+ */
+uint8_t Render_Engine_WorkersInit(render_workers_t *workers, uint8_t numWorkers,
+        uint16_t maxJobs, render_notify_t notify, void *data);
+
+/** @brief Stop render workers and free their memory
+ * 
+ * Jobs that were not started are dropped.
+ * 
+ * @param workers Workers to stop.
+ */
+void Render_Engine_WorkersDestroy(render_workers_t *workers);
+
+/** @brief Queue a frame for the render workers
+ * 
+ * The job is owned by the workers until Render_Engine_CollectJobs() returns
+ * it.
+ * 
+ * @param workers Workers to paint the frame.
+ * @param job Frame to paint.
+ * @return 1 if the job was queued, 0 if maxJobs jobs are already out.
+ */
+uint8_t Render_Engine_SubmitJob(render_workers_t *workers, render_job_t *job);
+
+/** @brief Take back finished frames
+ * 
+ * Never blocks. Jobs come back in the order they finished.
+ * 
+ * @param workers Workers that painted the frames.
+ * @param jobs Array to fill with finished jobs.
+ * @param maxJobs Size of the array.
+ * @return Number of jobs returned.
+ */
+uint16_t Render_Engine_CollectJobs(render_workers_t *workers, render_job_t **jobs,
+        uint16_t maxJobs);
+#endif
+
+/** @brief Copy a column layout frame into rows
+ * 
+ * The frame is copied in small blocks so both the columns read and the rows
+ * written stay in the cache.
+ * 
+ * @param framebuffer Frame with the RenderLayoutColumns layout.
+ * @param rows Buffer of width * height bytes to fill with the pixels in the
+ * RenderLayoutRows layout.
+ */
+void Render_Engine_TransposeFrame(framebuffer_t *framebuffer, uint8_t *rows);
+
+// Most bytes Render_Engine_EncodeFrame() writes for a frame of the given size
+#define RENDER_ENCODED_SIZE(width, height) \
+        (6 + (7 * (uint32_t) (width) * (height)) + (2 * (uint32_t) (height)))
+
+/** @brief Write a frame as terminal text
+ * 
+ * Fills a buffer with the same bytes Render_Engine_DisplayFrame() sends: the
+ * cursor moved to the origin, then the rows of the frame as spaces with a
+ * background color change wherever the color of a pixel differs from the one
+ * before. Frames in either layout are written out as rows. Needs no UART, so
+ * it is available with RENDER_ENGINE_HOST.
+ * 
+ * @param framebuffer Frame to encode.
+ * @param out Buffer of RENDER_ENCODED_SIZE(width, height) bytes.
+ * @return Number of bytes written.
+ */
+uint32_t Render_Engine_EncodeFrame(framebuffer_t *framebuffer, uint8_t *out);
+
 /** @brief Display a frame
  * 
  * Output the contents of a framebuffer over a UART channel. Before writing,
  * this function makes sure the UART buffer is empty. As there is so much data
  * sent over UART, buffers get in the way of operation. This directly accesses
  * the HAL UART code to get around the buffer of the UART code. This method is
- * blocking during the writing process.
+ * blocking during the writing process. Frames in either layout are written
+ * out as rows.
  * 
  * @param channel UART channel to output the framebuffer over.
  * @param framebuffer Framebuffer to display on the console.
  */
+#ifndef RENDER_ENGINE_HOST
 void Render_Engine_DisplayFrame(uint8_t channel, framebuffer_t *framebuffer);
+#endif
 
 /** @} */
 #endif // RENDER_ENGINE_H
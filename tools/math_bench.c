@@ -0,0 +1,195 @@
+/*
+ * math_bench.c
+ *
+ * Host tool that checks Render_Engine_FastAtan2() and Render_Engine_FastSqrt()
+ * against the C library on the corners the maze camera actually sees. The
+ * camera takes a random walk through the maze and every corner in front of it
+ * is projected both ways. The report gives the largest error of each function
+ * and of the final screen position in pixels, how many corners landed on a
+ * different pixel and how long each version takes per corner.
+ *
+ * Build from the repository root with:
+ *   gcc -O3 -DRENDER_ENGINE_HOST -I. tools/math_bench.c render_engine.c
+ *       maze_world.c -lm -o math_bench
+ *
+ * Usage:
+ *   math_bench [-w width] [-h height] [-p poses] [-s seed]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "render_engine.h"
+#include "maze_world.h"
+
+#define PI 3.14159265358979323846
+
+typedef struct corner {
+    rounding_t x;
+    rounding_t y;
+    rounding_t z;
+} corner_t;
+
+static double Seconds(struct timespec *start, struct timespec *end);
+static double WrapAngle(double angle);
+
+int main(int argc, char **argv) {
+    uint32_t width = 400;
+    uint32_t height = 120;
+    uint32_t numPoses = 2000;
+    uint32_t seed = 1;
+    int option;
+    
+    while ((option = getopt(argc, argv, "w:h:p:s:")) != -1) {
+        switch (option) {
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'h':
+                height = atoi(optarg);
+                break;
+            case 'p':
+                numPoses = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-w width] [-h height] [-p poses] "
+                        "[-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    if ((width == 0) || (height == 0) || (numPoses == 0)) {
+        fprintf(stderr, "usage: %s [-w width] [-h height] [-p poses] "
+                "[-s seed]\n", argv[0]);
+        return 1;
+    }
+    
+    world_t world;
+    render_instance_t instances[MAZE_NUM_INSTANCES];
+    MazeWorld_Build(&world, instances);
+    
+    // Collect every corner in front of the camera along a random walk
+    corner_t *corners = malloc((size_t) numPoses * world.numTriangles * 3 *
+            sizeof(corner_t));
+    camera_t camera;
+    maze_pose_t pose;
+    uint32_t numCorners = 0;
+    uint32_t i, t;
+    rounding_t fovHorizontal = 0, fovVertical = 0;
+    srand(seed);
+    MazeWorld_StartPose(&pose);
+    for (i = 0; i < numPoses; i++) {
+        MazeWorld_ApplyMove(&pose, rand() % MAZE_NUM_MOVES);
+        MazeWorld_SetCamera(&pose, &camera);
+        fovHorizontal = camera.fovHorizontal;
+        fovVertical = camera.fovVertical;
+        double yaw = camera.rotation.z * (PI / 180);
+        for (t = 0; t < world.numTriangles; t++) {
+            triangle_t triangle;
+            Render_Engine_GetTriangle(&world, t, &triangle);
+            vector_t *points[3] = {&triangle.p1, &triangle.p2, &triangle.p3};
+            uint8_t j;
+            for (j = 0; j < 3; j++) {
+                corner_t corner = {points[j]->x - camera.location.x,
+                        points[j]->y - camera.location.y,
+                        points[j]->z - camera.location.z};
+                if ((corner.x * cos(yaw)) + (corner.y * sin(yaw)) > 0) {
+                    corners[numCorners++] = corner;
+                }
+            }
+        }
+    }
+    
+    // Compare both versions corner by corner
+    double anglePerPixelHorizontal = (fovHorizontal * PI) / (width * 180.0);
+    double anglePerPixelVertical = (fovVertical * PI) / (height * 180.0);
+    double atanError = 0, sqrtError = 0, pixelError = 0;
+    uint32_t moved = 0;
+    for (i = 0; i < numCorners; i++) {
+        corner_t *c = &corners[i];
+        double flat = (c->x * c->x) + (c->y * c->y);
+        double exactHorizontal = atan2(c->y, c->x);
+        double exactVertical = atan2(c->z, sqrt(flat));
+        double fastHorizontal = Render_Engine_FastAtan2(c->y, c->x);
+        double fastVertical = Render_Engine_FastAtan2(c->z,
+                Render_Engine_FastSqrt((c->x * c->x) + (c->y * c->y)));
+        double error;
+        
+        error = fabs(WrapAngle(fastHorizontal - exactHorizontal));
+        atanError = (error > atanError) ? error : atanError;
+        if (flat > 0) {
+            error = fabs(Render_Engine_FastSqrt(flat) - sqrt(flat)) / sqrt(flat);
+            sqrtError = (error > sqrtError) ? error : sqrtError;
+        }
+        
+        // Error on screen, measured from the middle of the view
+        double exactX = (width / 2) - (exactHorizontal / anglePerPixelHorizontal);
+        double fastX = (width / 2) - (fastHorizontal / anglePerPixelHorizontal);
+        double exactY = (height / 2) - (exactVertical / anglePerPixelVertical);
+        double fastY = (height / 2) - (fastVertical / anglePerPixelVertical);
+        error = fabs(fastX - exactX);
+        pixelError = (error > pixelError) ? error : pixelError;
+        error = fabs(fastY - exactY);
+        pixelError = (error > pixelError) ? error : pixelError;
+        if ((floor(fastX) != floor(exactX)) || (floor(fastY) != floor(exactY))) {
+            moved++;
+        }
+    }
+    
+    // Time both versions over the same corners
+    struct timespec start, end;
+    double exactTime, fastTime;
+    volatile rounding_t sink = 0;
+    rounding_t sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numCorners; i++) {
+        corner_t *c = &corners[i];
+        sum += atan2(c->y, c->x) +
+                atan2(c->z, sqrt((c->x * c->x) + (c->y * c->y)));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    exactTime = Seconds(&start, &end);
+    sink = sum;
+    sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numCorners; i++) {
+        corner_t *c = &corners[i];
+        sum += Render_Engine_FastAtan2(c->y, c->x) + Render_Engine_FastAtan2(c->z,
+                Render_Engine_FastSqrt((c->x * c->x) + (c->y * c->y)));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fastTime = Seconds(&start, &end);
+    sink = sum;
+    (void) sink;
+    
+    printf("%u corners from %u poses, %ux%u\n", numCorners, numPoses, width, height);
+    printf("atan2 max error:  %.3g rad (%.4f of a pixel)\n", atanError,
+            atanError / ((anglePerPixelHorizontal < anglePerPixelVertical) ?
+            anglePerPixelHorizontal : anglePerPixelVertical));
+    printf("sqrt max error:   %.3g relative\n", sqrtError);
+    printf("screen max error: %.4f pixels, %u corners (%.3f%%) on another pixel\n",
+            pixelError, moved, (100.0 * moved) / numCorners);
+    printf("libm: %.1f ns per corner, fast: %.1f ns per corner, %.2fx\n",
+            exactTime * 1e9 / numCorners, fastTime * 1e9 / numCorners,
+            exactTime / fastTime);
+    
+    free(corners);
+    return 0;
+}
+
+double Seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + ((end->tv_nsec - start->tv_nsec) / 1e9);
+}
+
+double WrapAngle(double angle) {
+    if (angle > PI) {
+        return angle - (2 * PI);
+    } else if (angle < -PI) {
+        return angle + (2 * PI);
+    }
+    return angle;
+}
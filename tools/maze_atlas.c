@@ -0,0 +1,285 @@
+/*
+ * maze_atlas.c
+ *
+ * Host tool that renders a frame atlas for the 3D maze game. Every camera pose
+ * reachable from the start pose with up to the given number of keypresses is
+ * found with a breadth first search, rendered on a pool of threads and written
+ * as a frame atlas (see frame_atlas.h).
+ *
+ * Build from the repository root with:
+ *   gcc -O2 -DRENDER_ENGINE_HOST -I. tools/maze_atlas.c render_engine.c
+ *       maze_world.c frame_atlas.c -lm -lpthread -o maze_atlas
+ *
+ * Usage:
+ *   maze_atlas [-d depth] [-n max poses] [-t threads] [-c] output
+ *
+ * -c writes a C source file with a const maze_atlas array that can be linked
+ * into flash instead of a binary file that can be mapped with
+ * FrameAtlas_MapFile().
+ *
+ * Poses are only explored while the camera stays inside the bounding box of
+ * the maze, the atlas would be unbounded otherwise.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "render_engine.h"
+#include "maze_world.h"
+#include "frame_atlas.h"
+
+#define SCREEN_WIDTH 80
+#define SCREEN_HEIGHT 24
+
+typedef struct atlas_frame {
+    maze_pose_t pose;
+    uint32_t size;
+    uint8_t *data;
+} atlas_frame_t;
+
+struct atlas_builder_t {
+    world_t world;
+    render_instance_t instances[MAZE_NUM_INSTANCES];
+    render_vertices_t vertices;
+    rounding_t vertexStorage[3 * RENDER_VERTEX_STRIDE(MAZE_NUM_TRIANGLES)];
+    atlas_frame_t *frames;
+    uint32_t numFrames;
+    uint32_t nextFrame; ///< next frame a worker should render
+    int32_t minX, maxX, minY, maxY; ///< area the camera may move in
+    uint8_t *visited; ///< one bit for every lattice pose in the area
+    pthread_mutex_t lock;
+};
+static struct atlas_builder_t builder;
+
+static uint32_t FindPoses(uint32_t depth, uint32_t maxPoses);
+static uint8_t Visit(maze_pose_t *pose);
+static void *RenderWorker(void *unused);
+static int ComparePoses(const void *a, const void *b);
+static int WriteAtlas(const char *path, uint8_t cSource);
+
+int main(int argc, char **argv) {
+    uint32_t depth = 40;
+    uint32_t maxPoses = 20000;
+    uint32_t numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint8_t cSource = 0;
+    int option;
+    
+    while ((option = getopt(argc, argv, "d:n:t:c")) != -1) {
+        switch (option) {
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 'n':
+                maxPoses = atoi(optarg);
+                break;
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+            case 'c':
+                cSource = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d depth] [-n max poses] "
+                        "[-t threads] [-c] output\n", argv[0]);
+                return 1;
+        }
+    }
+    if ((optind >= argc) || (numThreads == 0)) {
+        fprintf(stderr, "usage: %s [-d depth] [-n max poses] "
+                "[-t threads] [-c] output\n", argv[0]);
+        return 1;
+    }
+    
+    MazeWorld_Build(&builder.world, builder.instances);
+    Render_Engine_LoadVertices(&builder.world, &builder.vertices,
+            builder.vertexStorage);
+    builder.numFrames = FindPoses(depth, maxPoses);
+    
+    // Render all the poses in parallel
+    struct timespec start, end;
+    pthread_t threads[numThreads];
+    uint32_t i;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_init(&builder.lock, 0);
+    for (i = 0; i < numThreads; i++) {
+        pthread_create(&threads[i], 0, RenderWorker, 0);
+    }
+    for (i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    // The atlas index must be sorted for the binary search
+    qsort(builder.frames, builder.numFrames, sizeof(atlas_frame_t), ComparePoses);
+    if (WriteAtlas(argv[optind], cSource) != 0) {
+        fprintf(stderr, "could not write %s\n", argv[optind]);
+        return 1;
+    }
+    
+    uint64_t bytes = 0;
+    for (i = 0; i < builder.numFrames; i++) {
+        bytes += builder.frames[i].size;
+    }
+    printf("%u poses rendered on %u threads in %.2f s, %llu bytes of frames "
+            "(%.1f bytes per frame, %.1fx smaller)\n",
+            builder.numFrames, numThreads,
+            (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9),
+            (unsigned long long) bytes,
+            (double) bytes / builder.numFrames,
+            ((double) builder.numFrames * SCREEN_WIDTH * SCREEN_HEIGHT) / bytes);
+    return 0;
+}
+
+uint32_t FindPoses(uint32_t depth, uint32_t maxPoses) {
+    // Find the area the camera may move in
+    uint32_t i;
+    for (i = 0; i < builder.world.numTriangles; i++) {
+        triangle_t t;
+        Render_Engine_GetTriangle(&builder.world, i, &t);
+        vector_t *points[3] = {&t.p1, &t.p2, &t.p3};
+        uint8_t j;
+        for (j = 0; j < 3; j++) {
+            int32_t x = points[j]->x * MAZE_POSE_SCALE;
+            int32_t y = points[j]->y * MAZE_POSE_SCALE;
+            builder.minX = (x < builder.minX) ? x : builder.minX;
+            builder.maxX = (x > builder.maxX) ? x : builder.maxX;
+            builder.minY = (y < builder.minY) ? y : builder.minY;
+            builder.maxY = (y > builder.maxY) ? y : builder.maxY;
+        }
+    }
+    
+    size_t area = (size_t) (builder.maxX - builder.minX + 1) *
+            (builder.maxY - builder.minY + 1);
+    builder.visited = calloc(((area * MAZE_POSE_YAW_STEPS) + 7) / 8, 1);
+    builder.frames = malloc(maxPoses * sizeof(atlas_frame_t));
+    
+    // Breadth first search, one level per keypress
+    uint32_t count = 0, levelStart = 0, levelEnd;
+    uint32_t level, f;
+    uint8_t move;
+    maze_pose_t pose;
+    MazeWorld_StartPose(&pose);
+    Visit(&pose);
+    builder.frames[count++].pose = pose;
+    for (level = 0; (level < depth) && (levelStart < count); level++) {
+        levelEnd = count;
+        for (f = levelStart; f < levelEnd; f++) {
+            for (move = 0; move < MAZE_NUM_MOVES; move++) {
+                pose = builder.frames[f].pose;
+                MazeWorld_ApplyMove(&pose, move);
+                if (!Visit(&pose)) {
+                    continue;
+                }
+                if (count == maxPoses) {
+                    return count;
+                }
+                builder.frames[count++].pose = pose;
+            }
+        }
+        levelStart = levelEnd;
+    }
+    
+    return count;
+}
+
+uint8_t Visit(maze_pose_t *pose) {
+    size_t width = builder.maxX - builder.minX + 1;
+    size_t height = builder.maxY - builder.minY + 1;
+    size_t bit;
+    
+    if ((pose->x < builder.minX) || (pose->x > builder.maxX) ||
+            (pose->y < builder.minY) || (pose->y > builder.maxY)) {
+        return 0;
+    }
+    
+    // Only visit each pose once
+    bit = ((((size_t) pose->yaw * height) + (pose->y - builder.minY)) * width) +
+            (pose->x - builder.minX);
+    if (builder.visited[bit / 8] & (1 << (bit % 8))) {
+        return 0;
+    }
+    builder.visited[bit / 8] |= 1 << (bit % 8);
+    return 1;
+}
+
+void *RenderWorker(void *unused) {
+    uint8_t buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+    uint8_t encoded[2 * SCREEN_WIDTH * SCREEN_HEIGHT];
+    framebuffer_t frame = {SCREEN_WIDTH, SCREEN_HEIGHT, buffer, RenderLayoutRows};
+    camera_t camera;
+    uint32_t f;
+    
+    (void) unused;
+    while (1) {
+        pthread_mutex_lock(&builder.lock);
+        f = builder.nextFrame++;
+        pthread_mutex_unlock(&builder.lock);
+        if (f >= builder.numFrames) {
+            return 0;
+        }
+        
+        MazeWorld_SetCamera(&builder.frames[f].pose, &camera);
+        Render_Engine_RenderFrame(&builder.world, &camera, &frame);
+        builder.frames[f].size = FrameAtlas_Encode(buffer,
+                SCREEN_WIDTH * SCREEN_HEIGHT, encoded);
+        builder.frames[f].data = malloc(builder.frames[f].size);
+        memcpy(builder.frames[f].data, encoded, builder.frames[f].size);
+    }
+}
+
+int ComparePoses(const void *a, const void *b) {
+    const maze_pose_t *poseA = &((const atlas_frame_t *) a)->pose;
+    const maze_pose_t *poseB = &((const atlas_frame_t *) b)->pose;
+    frame_cache_key_t keyA = {poseA->x, poseA->y, poseA->yaw};
+    frame_cache_key_t keyB = {poseB->x, poseB->y, poseB->yaw};
+    return FrameAtlas_CompareKeys(&keyA, &keyB);
+}
+
+int WriteAtlas(const char *path, uint8_t cSource) {
+    frame_atlas_header_t header = {{'M', 'Z', 'A', 'T'}, FRAME_ATLAS_VERSION,
+            SCREEN_WIDTH, SCREEN_HEIGHT, 0, builder.numFrames};
+    uint32_t size = sizeof(header) + (builder.numFrames * sizeof(frame_atlas_index_t));
+    uint32_t i;
+    
+    // Lay out the whole atlas in memory
+    for (i = 0; i < builder.numFrames; i++) {
+        size += builder.frames[i].size;
+    }
+    uint8_t *atlas = malloc(size);
+    frame_atlas_index_t *index = (frame_atlas_index_t *) (atlas + sizeof(header));
+    uint32_t offset = sizeof(header) + (builder.numFrames * sizeof(frame_atlas_index_t));
+    memcpy(atlas, &header, sizeof(header));
+    for (i = 0; i < builder.numFrames; i++) {
+        index[i].key.x = builder.frames[i].pose.x;
+        index[i].key.y = builder.frames[i].pose.y;
+        index[i].key.yaw = builder.frames[i].pose.yaw;
+        index[i].reserved = 0;
+        index[i].offset = offset;
+        memcpy(atlas + offset, builder.frames[i].data, builder.frames[i].size);
+        offset += builder.frames[i].size;
+    }
+    
+    FILE *file = fopen(path, cSource ? "w" : "wb");
+    if (file == 0) {
+        free(atlas);
+        return -1;
+    }
+    if (cSource) {
+        fprintf(file, "// Generated by tools/maze_atlas.c, do not edit\n"
+                "#include <stdint.h>\n\n"
+                "const uint32_t maze_atlas_size = %u;\n"
+                "const uint8_t maze_atlas[] __attribute__((aligned(4))) = {", size);
+        for (i = 0; i < size; i++) {
+            fprintf(file, "%s0x%02x,", (i % 16) ? " " : "\n    ", atlas[i]);
+        }
+        fprintf(file, "\n};\n");
+    } else {
+        fwrite(atlas, 1, size, file);
+    }
+    fclose(file);
+    free(atlas);
+    return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * maze_bench.c
+ *
+ * Host tool that generates mazes of growing size with MazeGrid_Generate() and
+ * compares the two ways of turning them into a world: one instance per cell
+ * base and wall (MazeWorld_Load()) and straight runs of walls merged into
+ * long walls (MazeWorld_LoadMerged()). For every size the report gives the
+ * grid and world memory, the triangle counts and the time per frame of both,
+ * plus how many pixels the merged walls paint differently because long walls
+ * sort badly against the cells around them.
+ *
+ * The last columns stream the per cell world through a pool of chunks around
+ * the camera (maze_stream.h): the most memory the resident chunks used, the
+ * chunks paged in per frame, the time per frame including the paging and the
+ * pixels that differ because walls outside the resident chunks are missing.
+ *
+ * Frames are taken from the middle of random cells looking in random
+ * directions, the same poses for both worlds. With -d every frame is rendered
+ * with that camera far distance, to see how much a limit saves in large mazes.
+ *
+ * Build from the repository root with:
+ *   gcc -O2 -DRENDER_ENGINE_HOST -I. tools/maze_bench.c render_engine.c
+ *       maze_world.c maze_stream.c -lm -o maze_bench
+ *
+ * Usage:
+ *   maze_bench [-w width] [-h height] [-f frames] [-m max cells] [-s seed]
+ *       [-r radius] [-d far distance]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "render_engine.h"
+#include "maze_world.h"
+#include "maze_stream.h"
+
+static double Seconds(struct timespec *start, struct timespec *end);
+static double TimeFrames(world_t *world, maze_pose_t *poses, uint32_t numFrames,
+        framebuffer_t *frame, uint8_t *frames, maze_stream_t *stream,
+        rounding_t farDistance);
+
+int main(int argc, char **argv) {
+    uint32_t width = 80;
+    uint32_t height = 24;
+    uint32_t numFrames = 50;
+    uint32_t maxCells = 128;
+    uint32_t seed = 1;
+    uint32_t radius = 1;
+    rounding_t farDistance = 0;
+    int option;
+    
+    while ((option = getopt(argc, argv, "w:h:f:m:s:r:d:")) != -1) {
+        switch (option) {
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'h':
+                height = atoi(optarg);
+                break;
+            case 'f':
+                numFrames = atoi(optarg);
+                break;
+            case 'm':
+                maxCells = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            case 'r':
+                radius = atoi(optarg);
+                break;
+            case 'd':
+                farDistance = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-w width] [-h height] [-f frames] "
+                        "[-m max cells] [-s seed] [-r radius] [-d far distance]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if ((width == 0) || (height == 0) || (width > UINT16_MAX) ||
+            (height > UINT16_MAX) || (numFrames == 0) || (maxCells < 2) ||
+            (maxCells > 256) || (radius > 8) || (farDistance < 0)) {
+        fprintf(stderr, "usage: %s [-w width] [-h height] [-f frames] "
+                "[-m max cells] [-s seed] [-r radius] [-d far distance]\n",
+                argv[0]);
+        return 1;
+    }
+    
+    // Sets up the lattice moves, the built in maze is not used
+    world_t world;
+    render_instance_t builtIn[MAZE_NUM_INSTANCES];
+    MazeWorld_Build(&world, builtIn);
+    
+    uint8_t *frames = malloc((size_t) numFrames * width * height);
+    uint8_t *merged = malloc((size_t) numFrames * width * height);
+    framebuffer_t frame = {width, height, 0, RenderLayoutRows};
+    maze_pose_t *poses = malloc(numFrames * sizeof(maze_pose_t));
+    uint16_t numChunks = ((2 * radius) + 1) * ((2 * radius) + 1);
+    maze_chunk_t *chunks = malloc(numChunks * sizeof(maze_chunk_t));
+    render_instance_t *pool = malloc(MAZE_STREAM_INSTANCES(numChunks) *
+            sizeof(render_instance_t));
+    uint32_t size, i;
+    
+    printf("%ux%u, %u frames per maze, %u chunks of %u cells streamed\n", width,
+            height, numFrames, numChunks, MAZE_CHUNK_SIZE * MAZE_CHUNK_SIZE);
+    printf(" cells   grid B  instances  world B  triangles  ms/frame | "
+            "merged  world B  ms/frame  pixels differ | "
+            "stream B  loads/frame  ms/frame  pixels differ\n");
+    for (size = 4; size <= maxCells; size *= 2) {
+        maze_grid_t grid;
+        uint8_t *cells = malloc(MAZE_GRID_BYTES(size, size));
+        render_instance_t *instances = malloc(MAZE_GRID_INSTANCES(size, size) *
+                sizeof(render_instance_t));
+        triangle_t *triangles = malloc(2 * MAZE_GRID_INSTANCES(size, size) *
+                sizeof(triangle_t));
+        uint32_t numTriangles, numMerged, numInstances;
+        double perCell, longWalls, streamed;
+        uint64_t differ = 0, missing = 0;
+        maze_stream_t stream;
+        
+        MazeGrid_Init(&grid, cells, size, size, size / 2, size / 2);
+        MazeGrid_Generate(&grid, seed + size);
+        
+        // Stand in the middle of random cells
+        srand(seed + size);
+        for (i = 0; i < numFrames; i++) {
+            poses[i].x = ((rand() % size) - (int32_t) (size / 2)) * 4 * MAZE_POSE_SCALE;
+            poses[i].y = ((rand() % size) - (int32_t) (size / 2)) * 4 * MAZE_POSE_SCALE;
+            poses[i].yaw = rand() % MAZE_POSE_YAW_STEPS;
+        }
+        
+        numTriangles = MazeWorld_Load(&world, &grid, instances);
+        numInstances = world.numInstances;
+        perCell = TimeFrames(&world, poses, numFrames, &frame, frames, 0,
+                farDistance);
+        numMerged = MazeWorld_LoadMerged(&world, &grid, triangles);
+        longWalls = TimeFrames(&world, poses, numFrames, &frame, merged, 0,
+                farDistance);
+        for (i = 0; i < numFrames * width * height; i++) {
+            differ += frames[i] != merged[i];
+        }
+        
+        // The poses jump around the maze, so most frames page in chunks
+        MazeStream_Init(&stream, &world, &grid, chunks, pool, numChunks, radius);
+        streamed = TimeFrames(&world, poses, numFrames, &frame, merged, &stream,
+                farDistance);
+        for (i = 0; i < numFrames * width * height; i++) {
+            missing += frames[i] != merged[i];
+        }
+        
+        printf("%3ux%-3u %7u  %9u  %7u  %9u  %8.3f | %6u  %7u  %8.3f  %12.2f%% | "
+                "%8u  %11.2f  %8.3f  %12.2f%%\n",
+                size, size, MAZE_GRID_BYTES(size, size), numInstances,
+                (uint32_t) (numInstances * sizeof(render_instance_t)), numTriangles,
+                perCell * 1000 / numFrames, numMerged,
+                (uint32_t) (numMerged * sizeof(triangle_t)),
+                longWalls * 1000 / numFrames,
+                (100.0 * differ) / ((double) numFrames * width * height),
+                (uint32_t) (stream.peakChunks * MAZE_STREAM_INSTANCES(1) *
+                sizeof(render_instance_t)),
+                (double) stream.loads / numFrames, streamed * 1000 / numFrames,
+                (100.0 * missing) / ((double) numFrames * width * height));
+        free(cells);
+        free(instances);
+        free(triangles);
+    }
+    
+    free(frames);
+    free(merged);
+    free(poses);
+    free(chunks);
+    free(pool);
+    return 0;
+}
+
+double Seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + ((end->tv_nsec - start->tv_nsec) / 1e9);
+}
+
+double TimeFrames(world_t *world, maze_pose_t *poses, uint32_t numFrames,
+        framebuffer_t *frame, uint8_t *frames, maze_stream_t *stream,
+        rounding_t farDistance) {
+    struct timespec start, end;
+    camera_t camera;
+    uint32_t i;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numFrames; i++) {
+        frame->buffer = frames + ((size_t) i * frame->width * frame->height);
+        MazeWorld_SetCamera(&poses[i], &camera);
+        if (farDistance > 0) {
+            camera.farDistance = farDistance;
+        }
+        if (stream != 0) {
+            MazeStream_Update(stream, &camera.location);
+        }
+        Render_Engine_RenderFrame(world, &camera, frame);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return Seconds(&start, &end);
+}
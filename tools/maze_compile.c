@@ -0,0 +1,218 @@
+/*
+ * maze_compile.c
+ *
+ * Host tool that compiles an ASCII map of a maze into const C data for the 3D
+ * maze game (see maze_level_t in maze_world.h). The grid cells and the
+ * instances of the world are worked out here with MazeGrid_SetWalls() and
+ * MazeWorld_Load(), so the game renders straight from flash and does not build
+ * anything in Play().
+ *
+ * Build from the repository root with:
+ *   gcc -O2 -DRENDER_ENGINE_HOST -I. tools/maze_compile.c render_engine.c
+ *       maze_world.c -lm -o maze_compile
+ *
+ * Usage:
+ *   maze_compile map output
+ *
+ * Writes output.c with the const maze_level and output.h with its declaration
+ * and the MAZE_LEVEL_TRIANGLES and MAZE_LEVEL_INSTANCES sizes.
+ *
+ * The map is seen from above with positive y up. Lines alternate between
+ * corner lines and cell lines, starting and ending with a corner line. Corners
+ * are '+' and the first line sets how many characters apart they are. A '-'
+ * after a corner is a wall along x, a '|' under a corner is a wall along y.
+ * 'E' inside a cell marks the exit and 'S' the cell the player starts in,
+ * without an 'S' the player starts in the exit column on the bottom row. The
+ * edge of the maze is always a wall. levels/builtin.maze is the built in maze:
+ *
+ *   +---+---+---+
+ *   | E     |   |
+ *   +---+   +   +
+ *   | S         |
+ *   +---+---+---+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "render_engine.h"
+#include "maze_world.h"
+
+#define MAX_LINE 2048 ///< longest line of a map
+#define MAX_CELLS 256 ///< most cells along either side of a map
+
+static int ReadMap(const char *path, maze_grid_t *grid);
+static char MapChar(char **lines, uint32_t numLines, uint32_t line, uint32_t column);
+static int WriteLevel(const char *output, const char *map, maze_grid_t *grid,
+        render_instance_t *instances, uint32_t numInstances, uint32_t numTriangles);
+
+int main(int argc, char **argv) {
+    maze_grid_t grid;
+    world_t world;
+    render_instance_t *instances;
+    uint32_t numTriangles;
+    
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s map output\n", argv[0]);
+        return 1;
+    }
+    if (ReadMap(argv[1], &grid) != 0) {
+        return 1;
+    }
+    
+    instances = malloc(MAZE_GRID_INSTANCES(grid.width, grid.height) *
+            sizeof(render_instance_t));
+    numTriangles = MazeWorld_Load(&world, &grid, instances);
+    if (WriteLevel(argv[2], argv[1], &grid, instances, world.numInstances,
+            numTriangles) != 0) {
+        fprintf(stderr, "could not write %s.c and %s.h\n", argv[2], argv[2]);
+        return 1;
+    }
+    
+    printf("%ux%u maze, %u triangles from %u instances: %u bytes of const data "
+            "(%u bytes as triangles)\n", grid.width, grid.height, numTriangles,
+            world.numInstances,
+            (uint32_t) ((world.numInstances * sizeof(render_instance_t)) +
+            MAZE_GRID_BYTES(grid.width, grid.height) + sizeof(maze_level_t)),
+            (uint32_t) (numTriangles * sizeof(triangle_t)));
+    return 0;
+}
+
+int ReadMap(const char *path, maze_grid_t *grid) {
+    FILE *file = fopen(path, "r");
+    char **lines = 0;
+    char buffer[MAX_LINE];
+    uint32_t numLines = 0, step, width, height, line, column;
+    uint16_t x, y, exitX = UINT16_MAX, exitY = 0, startX = UINT16_MAX, startY = 0;
+    
+    if (file == 0) {
+        fprintf(stderr, "could not read %s\n", path);
+        return -1;
+    }
+    while (fgets(buffer, sizeof(buffer), file) != 0) {
+        buffer[strcspn(buffer, "\r\n")] = 0;
+        lines = realloc(lines, (numLines + 1) * sizeof(char *));
+        lines[numLines++] = strdup(buffer);
+    }
+    fclose(file);
+    
+    // Size of the maze from the first corner line
+    while ((numLines > 0) && (lines[numLines - 1][0] == 0)) {
+        numLines--;
+    }
+    step = (numLines > 0) ? strcspn(lines[0] + 1, "+") + 1 : 0;
+    if ((numLines < 3) || (numLines % 2 == 0) || (lines[0][0] != '+') ||
+            (step < 2) || ((strlen(lines[0]) - 1) % step != 0)) {
+        fprintf(stderr, "%s: not a maze map\n", path);
+        return -1;
+    }
+    width = (strlen(lines[0]) - 1) / step;
+    height = (numLines - 1) / 2;
+    if ((width > MAX_CELLS) || (height > MAX_CELLS)) {
+        fprintf(stderr, "%s: larger than %u by %u cells\n", path, MAX_CELLS,
+                MAX_CELLS);
+        return -1;
+    }
+    
+    // The first lines of the map are the far end of the maze
+    MazeGrid_Init(grid, calloc(MAZE_GRID_BYTES(width, height), 1), width, height,
+            0, 0);
+    for (y = 0; y < height; y++) {
+        line = 2 * (height - y) - 1;
+        for (x = 0; x < width; x++) {
+            column = x * step;
+            if (MapChar(lines, numLines, line - 1, column + 1) == '-') {
+                MazeGrid_SetWalls(grid, x, y, MazeWallPosY, 1);
+            }
+            if (MapChar(lines, numLines, line, column) == '|') {
+                MazeGrid_SetWalls(grid, x, y, MazeWallNegX, 1);
+            }
+            for (column = (x * step) + 1; column < (x + 1) * step; column++) {
+                char c = MapChar(lines, numLines, line, column);
+                if ((c == 'E') && (exitX == UINT16_MAX)) {
+                    exitX = x;
+                    exitY = y;
+                } else if ((c == 'S') && (startX == UINT16_MAX)) {
+                    startX = x;
+                    startY = y;
+                } else if ((c == 'E') || (c == 'S')) {
+                    fprintf(stderr, "%s:%u: second '%c'\n", path, line + 1, c);
+                    return -1;
+                }
+            }
+        }
+    }
+    if (exitX == UINT16_MAX) {
+        fprintf(stderr, "%s: no exit 'E'\n", path);
+        return -1;
+    }
+    
+    grid->exitX = exitX;
+    grid->exitY = exitY;
+    grid->startX = (startX != UINT16_MAX) ? startX : exitX;
+    grid->startY = (startX != UINT16_MAX) ? startY : 0;
+    return 0;
+}
+
+char MapChar(char **lines, uint32_t numLines, uint32_t line, uint32_t column) {
+    // Lines may stop early, the rest of them is empty
+    if ((line >= numLines) || (column >= strlen(lines[line]))) {
+        return ' ';
+    }
+    return lines[line][column];
+}
+
+int WriteLevel(const char *output, const char *map, maze_grid_t *grid,
+        render_instance_t *instances, uint32_t numInstances, uint32_t numTriangles) {
+    char path[FILENAME_MAX];
+    const char *header;
+    FILE *file;
+    uint32_t i;
+    
+    snprintf(path, sizeof(path), "%s.h", output);
+    if ((file = fopen(path, "w")) == 0) {
+        return -1;
+    }
+    fprintf(file, "// Generated by tools/maze_compile.c from %s, do not edit\n"
+            "#ifndef MAZE_LEVEL_H\n"
+            "#define MAZE_LEVEL_H\n\n"
+            "#include \"maze_world.h\"\n\n"
+            "#define MAZE_LEVEL_TRIANGLES %u ///< triangles in maze_level\n"
+            "#define MAZE_LEVEL_INSTANCES %u ///< instances in maze_level\n\n"
+            "extern const maze_level_t maze_level;\n\n"
+            "#endif\n", map, numTriangles, numInstances);
+    fclose(file);
+    
+    // The source includes the header from the same directory
+    header = strrchr(output, '/');
+    header = (header != 0) ? header + 1 : output;
+    snprintf(path, sizeof(path), "%s.c", output);
+    if ((file = fopen(path, "w")) == 0) {
+        return -1;
+    }
+    fprintf(file, "// Generated by tools/maze_compile.c from %s, do not edit\n"
+            "#include \"%s.h\"\n\n"
+            "static const uint8_t cells[%u] = {", map,
+            header,
+            MAZE_GRID_BYTES(grid->width, grid->height));
+    for (i = 0; i < MAZE_GRID_BYTES(grid->width, grid->height); i++) {
+        fprintf(file, "%s0x%02x,", (i % 16) ? " " : "\n    ", grid->cells[i]);
+    }
+    fprintf(file, "\n};\n\n"
+            "// Offset, first triangle, mesh and color of each tile\n"
+            "static const render_instance_t instances[MAZE_LEVEL_INSTANCES] = {\n");
+    for (i = 0; i < numInstances; i++) {
+        fprintf(file, "    {{%g, %g, %g}, %u, %u, %u},\n",
+                (double) instances[i].offset.x, (double) instances[i].offset.y,
+                (double) instances[i].offset.z, instances[i].first,
+                instances[i].mesh, instances[i].color);
+    }
+    fprintf(file, "};\n\n"
+            "const maze_level_t maze_level = {\n"
+            "    {cells, 0, %u, %u, %u, %u, %u, %u},\n"
+            "    instances, MAZE_LEVEL_INSTANCES, MAZE_LEVEL_TRIANGLES\n"
+            "};\n", grid->width, grid->height, grid->exitX, grid->exitY,
+            grid->startX, grid->startY);
+    fclose(file);
+    return 0;
+}
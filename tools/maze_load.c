@@ -0,0 +1,491 @@
+/*
+ * maze_load.c
+ *
+ * Host tool that loads tools/maze_server.c with simulated players. Every
+ * player is a bot that solves the maze: a breadth first search from the exit
+ * over the grid gives each cell its distance to the exit, and the bot walks
+ * from cell center to cell center, always to the open neighbour one step
+ * closer. It plays through the same keys a person would ('w', 'a', 's', 'd',
+ * '<' and '>'), so the server cannot tell it from a terminal. Turning bots
+ * face the way they walk and only press 'w'; strafing bots never turn and
+ * step sideways and backwards as well. By default half the players are each.
+ *
+ * Each bot keeps its own copy of its pose by applying its keys with the same
+ * maze_world.h functions the server uses, so it knows which keys move it and
+ * when it reaches the exit. The server then starts the player over and so
+ * does the bot. A bot sends one key, waits for the frame answering it, thinks
+ * for the think time (+-50% so the players drift apart) and sends the next.
+ * Frames are found in the stream by the cursor home sequence that starts each
+ * of them.
+ *
+ * The maze must be the one the server plays: the built in maze, or -m and -s
+ * given the same as to the server. Every second it prints the players
+ * connected, keys and frames per second, bytes received and the key to frame
+ * latency (key sent to the start of its frame received). The totals are
+ * printed at the end of the run.
+ *
+ * Build from the repository root with:
+ *   gcc -O2 -DRENDER_ENGINE_HOST -I. tools/maze_load.c render_engine.c
+ *       maze_world.c -lm -o maze_load
+ *
+ * Usage:
+ *   maze_load [-p port] [-u unix path] [-n players] [-k think ms]
+ *       [-b turn|strafe|mix] [-m random maze cells] [-s seed] [-t seconds]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "render_engine.h"
+#include "maze_world.h"
+
+#define MAX_EVENTS 256
+#define LATENCY_BUCKETS 100000 ///< 10 us buckets, the last one holds the rest
+#define CELL_LATTICE (MAZE_CELL_SIZE * MAZE_POSE_SCALE) ///< lattice units per cell
+#define QUARTER_TURN (MAZE_POSE_YAW_STEPS / 4) ///< turn steps in a quarter turn
+
+typedef struct player {
+    int fd; ///< -1 once disconnected
+    maze_pose_t pose; ///< pose the server has, kept by applying the same keys
+    uint16_t targetX; ///< cell the bot walks to the center of
+    uint16_t targetY;
+    uint8_t strafe; ///< steps sideways instead of turning
+    uint8_t waiting; ///< a frame answering the last key is expected
+    uint8_t matched; ///< bytes of the frame start sequence seen so far
+    uint32_t sentTime; ///< time the key being answered was sent
+    uint32_t nextTime; ///< time to send the next key
+    uint32_t keys; ///< keys sent
+} player_t;
+
+typedef struct stats {
+    uint64_t keys; ///< keys sent
+    uint64_t frames; ///< frames received
+    uint64_t bytes; ///< bytes received
+    uint64_t wins; ///< times a bot reached the exit
+    uint32_t latency[LATENCY_BUCKETS]; ///< key to frame latencies
+} stats_t;
+
+static const maze_grid_t *grid;
+static uint32_t *distance;
+static maze_pose_t start;
+static uint32_t think;
+static player_t *players;
+static uint32_t numPlayers;
+static uint32_t connected;
+static stats_t interval;
+static stats_t total;
+
+static uint32_t Micros(void);
+static void FindDistances(void);
+static int Connect(uint16_t port, const char *path);
+static void ResetBot(player_t *player);
+static uint8_t NextMove(player_t *player);
+static void SendKey(player_t *player, uint32_t now);
+static void ReadFrames(player_t *player, uint32_t now);
+static void Disconnect(player_t *player);
+static void AddStats(stats_t *to, stats_t *from);
+static uint32_t Percentile(stats_t *stats, uint32_t percent);
+static void PrintStats(const char *label, stats_t *stats, double seconds);
+
+int main(int argc, char **argv) {
+    uint32_t port = 4000;
+    const char *path = 0;
+    const char *bots = "mix";
+    uint32_t mazeCells = 0;
+    uint32_t seed = 1;
+    uint32_t seconds = 10;
+    int option;
+    
+    numPlayers = 100;
+    think = 100;
+    while ((option = getopt(argc, argv, "p:u:n:k:b:m:s:t:")) != -1) {
+        switch (option) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'u':
+                path = optarg;
+                break;
+            case 'n':
+                numPlayers = atoi(optarg);
+                break;
+            case 'k':
+                think = atoi(optarg);
+                break;
+            case 'b':
+                bots = optarg;
+                break;
+            case 'm':
+                mazeCells = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-u unix path] [-n players] "
+                        "[-k think ms] [-b turn|strafe|mix] [-m random maze cells] "
+                        "[-s seed] [-t seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if ((port > UINT16_MAX) || (numPlayers == 0) || (seconds == 0) ||
+            ((mazeCells != 0) && ((mazeCells < 2) || (mazeCells > 256))) ||
+            ((strcmp(bots, "turn") != 0) && (strcmp(bots, "strafe") != 0) &&
+            (strcmp(bots, "mix") != 0))) {
+        fprintf(stderr, "usage: %s [-p port] [-u unix path] [-n players] "
+                "[-k think ms] [-b turn|strafe|mix] [-m random maze cells] "
+                "[-s seed] [-t seconds]\n", argv[0]);
+        return 1;
+    }
+    think *= 1000;
+    
+    // The same maze the server builds, only the grid and poses are needed
+    world_t world;
+    maze_grid_t random;
+    render_instance_t builtIn[MAZE_NUM_INSTANCES];
+    MazeWorld_Build(&world, builtIn);
+    if (mazeCells != 0) {
+        MazeGrid_Init(&random, malloc(MAZE_GRID_BYTES(mazeCells, mazeCells)),
+                mazeCells, mazeCells, mazeCells / 2, mazeCells / 2);
+        MazeGrid_Generate(&random, seed);
+        MazeWorld_Load(&world, &random, malloc(MAZE_GRID_INSTANCES(mazeCells,
+                mazeCells) * sizeof(render_instance_t)));
+    }
+    grid = MazeWorld_Grid();
+    MazeWorld_StartPose(&start);
+    FindDistances();
+    if (distance[(grid->startY * grid->width) + grid->startX] == UINT32_MAX) {
+        fprintf(stderr, "the exit cannot be reached from the start\n");
+        return 1;
+    }
+    
+    int epollFd = epoll_create1(0);
+    struct epoll_event event;
+    uint32_t now = Micros();
+    uint32_t i;
+    players = malloc(numPlayers * sizeof(player_t));
+    srand(seed);
+    for (i = 0; i < numPlayers; i++) {
+        player_t *player = &players[i];
+        player->fd = Connect(port, path);
+        if (player->fd < 0) {
+            fprintf(stderr, "connected %u of %u players\n", i, numPlayers);
+            return 1;
+        }
+        player->strafe = (strcmp(bots, "strafe") == 0) ||
+                ((strcmp(bots, "mix") == 0) && (i % 2));
+        ResetBot(player);
+        player->matched = 0;
+        player->keys = 0;
+        
+        // The server sends the first frame unasked
+        player->waiting = 1;
+        player->sentTime = now;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, player->fd, &event);
+        connected++;
+    }
+    printf("%u %s bots, %u ms think time, %s maze\n", numPlayers, bots,
+            think / 1000, (mazeCells != 0) ? "a random" : "the built in");
+    printf("players    keys/s  frames/s      MB/s  p50 ms  p99 ms  max ms  wins\n");
+    
+    struct epoll_event events[MAX_EVENTS];
+    uint32_t begin = Micros();
+    uint32_t lastStats = begin;
+    int numEvents, n;
+    
+    while (((now = Micros()) - begin) < seconds * 1000000) {
+        // Keys are due on a millisecond clock, good enough for think times
+        numEvents = epoll_wait(epollFd, events, MAX_EVENTS, 1);
+        now = Micros();
+        for (n = 0; n < numEvents; n++) {
+            if (players[events[n].data.u32].fd >= 0) {
+                ReadFrames(&players[events[n].data.u32], now);
+            }
+        }
+        for (i = 0; i < numPlayers; i++) {
+            if ((players[i].fd >= 0) && !players[i].waiting &&
+                    ((int32_t) (now - players[i].nextTime) >= 0)) {
+                SendKey(&players[i], now);
+            }
+        }
+        
+        if ((now - lastStats) >= 1000000) {
+            PrintStats("", &interval, (now - lastStats) / 1e6);
+            AddStats(&total, &interval);
+            memset(&interval, 0, sizeof(interval));
+            lastStats = now;
+        }
+    }
+    
+    AddStats(&total, &interval);
+    PrintStats("total\n", &total, (Micros() - begin) / 1e6);
+    return 0;
+}
+
+uint32_t Micros(void) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((now.tv_sec * 1000000ull) + (now.tv_nsec / 1000));
+}
+
+void FindDistances(void) {
+    uint32_t numCells = (uint32_t) grid->width * grid->height;
+    uint32_t *queue = malloc(numCells * sizeof(uint32_t));
+    uint32_t head = 0, tail = 0;
+    uint32_t cell, next;
+    uint16_t x, y;
+    uint8_t walls;
+    
+    // Breadth first from the exit, every cell learns its steps to the exit
+    distance = malloc(numCells * sizeof(uint32_t));
+    for (cell = 0; cell < numCells; cell++) {
+        distance[cell] = UINT32_MAX;
+    }
+    cell = (grid->exitY * grid->width) + grid->exitX;
+    distance[cell] = 0;
+    queue[tail++] = cell;
+    while (head < tail) {
+        cell = queue[head++];
+        x = cell % grid->width;
+        y = cell / grid->width;
+        walls = MazeGrid_Walls(grid, x, y);
+        uint32_t neighbours[4] = {
+            (walls & MazeWallPosX) ? UINT32_MAX : cell + 1,
+            (walls & MazeWallNegX) ? UINT32_MAX : cell - 1,
+            (walls & MazeWallPosY) ? UINT32_MAX : cell + grid->width,
+            (walls & MazeWallNegY) ? UINT32_MAX : cell - grid->width
+        };
+        for (next = 0; next < 4; next++) {
+            if ((neighbours[next] != UINT32_MAX) &&
+                    (distance[neighbours[next]] == UINT32_MAX)) {
+                distance[neighbours[next]] = distance[cell] + 1;
+                queue[tail++] = neighbours[next];
+            }
+        }
+    }
+    free(queue);
+}
+
+int Connect(uint16_t port, const char *path) {
+    struct sockaddr_in inet;
+    struct sockaddr_un local;
+    int fd, one = 1;
+    
+    if (path == 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        memset(&inet, 0, sizeof(inet));
+        inet.sin_family = AF_INET;
+        inet.sin_port = htons(port);
+        inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (struct sockaddr *) &inet, sizeof(inet)) < 0) {
+            perror("connect");
+            return -1;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        strncpy(local.sun_path, path, sizeof(local.sun_path) - 1);
+        if (connect(fd, (struct sockaddr *) &local, sizeof(local)) < 0) {
+            perror("connect");
+            return -1;
+        }
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+void ResetBot(player_t *player) {
+    player->pose = start;
+    player->targetX = grid->startX;
+    player->targetY = grid->startY;
+}
+
+uint8_t NextMove(player_t *player) {
+    maze_pose_t *pose = &player->pose;
+    uint32_t cell = (player->targetY * grid->width) + player->targetX;
+    int32_t dx, dy;
+    uint8_t walls, heading, facing, wanted;
+    
+    // Reached the middle of the target cell, aim for the next one closer to
+    // the exit. Cells are centered on their lattice point, the exit at 0, 0
+    dx = ((player->targetX - grid->exitX) * CELL_LATTICE) - pose->x;
+    dy = ((player->targetY - grid->exitY) * CELL_LATTICE) - pose->y;
+    if ((dx == 0) && (dy == 0)) {
+        walls = MazeGrid_Walls(grid, player->targetX, player->targetY);
+        if (!(walls & MazeWallPosX) && (distance[cell + 1] < distance[cell])) {
+            player->targetX++;
+        } else if (!(walls & MazeWallNegX) && (distance[cell - 1] < distance[cell])) {
+            player->targetX--;
+        } else if (!(walls & MazeWallPosY) &&
+                (distance[cell + grid->width] < distance[cell])) {
+            player->targetY++;
+        } else {
+            player->targetY--;
+        }
+        dx = ((player->targetX - grid->exitX) * CELL_LATTICE) - pose->x;
+        dy = ((player->targetY - grid->exitY) * CELL_LATTICE) - pose->y;
+    }
+    
+    // Quarter turns left from the start facing: +y, -x, -y, +x
+    if (dx != 0) {
+        heading = (dx > 0) ? 3 : 1;
+    } else {
+        heading = (dy > 0) ? 0 : 2;
+    }
+    if (player->strafe) {
+        // Never turns, so the facing is always a whole quarter turn
+        facing = ((pose->yaw + MAZE_POSE_YAW_STEPS - start.yaw) %
+                MAZE_POSE_YAW_STEPS) / QUARTER_TURN;
+        switch ((heading + 4 - facing) % 4) {
+            case 0:
+                return MazeForward;
+            case 1:
+                return MazeLeft;
+            case 2:
+                return MazeBackward;
+            default:
+                return MazeRight;
+        }
+    }
+    
+    // Turn the short way round until facing the way to go, then walk
+    wanted = (start.yaw + (heading * QUARTER_TURN)) % MAZE_POSE_YAW_STEPS;
+    if (pose->yaw == wanted) {
+        return MazeForward;
+    } else if (((wanted + MAZE_POSE_YAW_STEPS - pose->yaw) % MAZE_POSE_YAW_STEPS) <=
+            (MAZE_POSE_YAW_STEPS / 2)) {
+        return MazeTurnLeft;
+    }
+    return MazeTurnRight;
+}
+
+void SendKey(player_t *player, uint32_t now) {
+    static const uint8_t keys[MAZE_NUM_MOVES] = {'w', 's', 'a', 'd', '<', '>'};
+    maze_pose_t before = player->pose;
+    uint8_t move = NextMove(player);
+    
+    if (write(player->fd, &keys[move], 1) != 1) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            Disconnect(player);
+        }
+        return;
+    }
+    player->keys++;
+    interval.keys++;
+    player->sentTime = now;
+    
+    // The server only sends a frame when the pose changed. At the exit it
+    // starts the player over and sends the frame of the start instead
+    MazeWorld_ApplyMove(&player->pose, move);
+    player->waiting = (player->pose.x != before.x) || (player->pose.y != before.y) ||
+            (player->pose.yaw != before.yaw);
+    if (MazeWorld_AtExit(&player->pose)) {
+        interval.wins++;
+        ResetBot(player);
+    }
+    if (!player->waiting) {
+        player->nextTime = now + think;
+    }
+}
+
+void ReadFrames(player_t *player, uint32_t now) {
+    static const char home[] = "\x1b[1;1H"; // starts every frame
+    uint8_t buffer[16384];
+    uint32_t latency;
+    ssize_t count, i;
+    
+    while ((count = read(player->fd, buffer, sizeof(buffer))) > 0) {
+        interval.bytes += count;
+        for (i = 0; i < count; i++) {
+            if (buffer[i] != (uint8_t) home[player->matched]) {
+                player->matched = (buffer[i] == (uint8_t) home[0]);
+                continue;
+            }
+            if (++player->matched < sizeof(home) - 1) {
+                continue;
+            }
+            player->matched = 0;
+            interval.frames++;
+            if (!player->waiting) {
+                continue;
+            }
+            
+            // The first frame answers no key
+            if (player->keys > 0) {
+                latency = (now - player->sentTime) / 10;
+                interval.latency[(latency < LATENCY_BUCKETS) ? latency :
+                        LATENCY_BUCKETS - 1]++;
+            }
+            player->waiting = 0;
+            player->nextTime = now + (think / 2) + ((think > 0) ?
+                    (uint32_t) (rand() % think) : 0);
+        }
+    }
+    if ((count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+        Disconnect(player);
+    }
+}
+
+void Disconnect(player_t *player) {
+    close(player->fd);
+    player->fd = -1;
+    connected--;
+}
+
+void AddStats(stats_t *to, stats_t *from) {
+    uint32_t i;
+    
+    to->keys += from->keys;
+    to->frames += from->frames;
+    to->bytes += from->bytes;
+    to->wins += from->wins;
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        to->latency[i] += from->latency[i];
+    }
+}
+
+uint32_t Percentile(stats_t *stats, uint32_t percent) {
+    uint64_t count = 0, seen = 0;
+    uint32_t i;
+    
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        count += stats->latency[i];
+    }
+    if (count == 0) {
+        return 0;
+    }
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += stats->latency[i];
+        if (seen * 100 >= count * percent) {
+            break;
+        }
+    }
+    return (i + 1) * 10;
+}
+
+void PrintStats(const char *label, stats_t *stats, double seconds) {
+    printf("%s%7u  %8.0f  %8.0f  %8.2f  %6.2f  %6.2f  %6.2f  %4llu\n", label,
+            connected, stats->keys / seconds, stats->frames / seconds,
+            stats->bytes / seconds / 1e6, Percentile(stats, 50) / 1000.0,
+            Percentile(stats, 99) / 1000.0, Percentile(stats, 100) / 1000.0,
+            (unsigned long long) stats->wins);
+    fflush(stdout);
+}
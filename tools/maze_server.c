@@ -0,0 +1,658 @@
+/*
+ * maze_server.c
+ *
+ * Host program that serves the 3D maze to many terminal clients at once, over
+ * local TCP and/or a Unix socket. Every connection is a player with its own
+ * session (maze_session.h) in one shared world, all served round robin by one
+ * render loop with one shared frame cache. Bytes from a client are its keys,
+ * the same ones the game takes over the UART, and every frame it is shown is
+ * sent back as the terminal text Render_Engine_EncodeFrame() writes.
+ *
+ * The loop never blocks on a client. Sockets are non-blocking and polled with
+ * epoll; frames are only rendered between polls, a few milliseconds at a time.
+ * Every client has two encoded frames: the one going out and the newest one
+ * waiting behind it. Both are written with one writev(), and a client too slow
+ * to take a frame before the next is ready gets only the newer one, so a slow
+ * reader costs no memory and never stalls the others.
+ *
+ * Built with RENDER_ENGINE_THREADS, -w hands the frames to that many render
+ * workers (render_workers_t) instead, so frames of many players are painted
+ * at once on all cores while the loop keeps serving the sockets. Workers wake
+ * the loop through an eventfd when a frame is done.
+ *
+ * Every second it prints the clients connected, frames and bytes sent, frames
+ * rendered and taken from the cache, frames dropped for slow clients and the
+ * key to frame latency (time from reading a key to the frame answering it
+ * being queued). The totals are printed when it stops, after -t seconds or on
+ * SIGINT.
+ *
+ * Build from the repository root with:
+ *   gcc -O2 -DRENDER_ENGINE_HOST -I. tools/maze_server.c render_engine.c
+ *       maze_world.c maze_session.c frame_cache.c -lm -o maze_server
+ * or, for render workers:
+ *   gcc -O2 -DRENDER_ENGINE_HOST -DRENDER_ENGINE_THREADS -I.
+ *       tools/maze_server.c render_engine.c maze_world.c maze_session.c
+ *       frame_cache.c -lm -lpthread -o maze_server
+ *
+ * Usage:
+ *   maze_server [-p port] [-u unix path] [-n max clients] [-c cache frames]
+ *       [-m random maze cells] [-s seed] [-t seconds] [-w workers]
+ *
+ * Play with `stty raw -echo; nc 127.0.0.1 4000; stty sane`, 'q' leaves. With
+ * -m the maze is MazeGrid_Generate(seed) of that many cells a side, otherwise
+ * the built in maze. -p 0 serves only the Unix socket.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#ifdef RENDER_ENGINE_THREADS
+#include <sys/eventfd.h>
+#endif
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "render_engine.h"
+#include "frame_cache.h"
+#include "maze_world.h"
+#include "maze_session.h"
+
+#define SCREEN_WIDTH 80
+#define SCREEN_HEIGHT 24
+#define FRAME_BYTES RENDER_ENCODED_SIZE(SCREEN_WIDTH, SCREEN_HEIGHT)
+#define MAX_EVENTS 256
+#define RENDER_SLICE 2000 ///< most microseconds rendered between polls
+#define LATENCY_BUCKETS 10000 ///< 10 us buckets, the last one holds the rest
+#define LISTEN_TCP UINT32_MAX ///< epoll data of the TCP listener
+#define LISTEN_UNIX (UINT32_MAX - 1) ///< epoll data of the Unix listener
+#define WORKERS_DONE (UINT32_MAX - 2) ///< epoll data of the workers' eventfd
+
+typedef struct client {
+    int fd; ///< -1 if the slot is free
+    maze_session_t *session;
+    uint8_t frame[SCREEN_WIDTH * SCREEN_HEIGHT]; ///< frame of the session
+    uint8_t buffers[2][FRAME_BYTES]; ///< encoded frames, sending and pending
+    uint8_t *sending; ///< frame being written
+    uint32_t sendLength; ///< bytes of the frame being written
+    uint32_t sent; ///< bytes of it written so far
+    uint8_t *pending; ///< newest frame, written after the one being sent
+    uint32_t pendingLength; ///< bytes of the newest frame, 0 if none
+    uint8_t waiting; ///< EPOLLOUT is armed
+} client_t;
+
+typedef struct stats {
+    uint64_t frames; ///< frames written out completely
+    uint64_t bytes; ///< bytes written
+    uint64_t dropped; ///< frames replaced before they started going out
+    uint64_t keys; ///< key bytes read
+    uint64_t wins; ///< players that reached the exit
+    uint64_t accepted; ///< connections accepted
+    uint32_t renders; ///< MazeSessions_Step() frames rendered
+    uint32_t cacheFrames; ///< MazeSessions_Step() frames copied from the cache
+    uint32_t latency[LATENCY_BUCKETS]; ///< key to frame latencies
+} stats_t;
+
+static volatile sig_atomic_t running = 1;
+static int epollFd;
+static client_t *clients;
+static uint32_t maxClients;
+static uint32_t numClients;
+static maze_sessions_t sessions;
+static stats_t interval;
+static stats_t total;
+#ifdef RENDER_ENGINE_THREADS
+static render_workers_t workers;
+static int doneFd;
+#endif
+
+static void Stop(int signal);
+static uint32_t Micros(void);
+static int Listen(uint16_t port, const char *path);
+static void AcceptClients(int listener);
+static void ReadKeys(client_t *client);
+static void DropClient(client_t *client);
+static void Flush(client_t *client);
+static void Watch(client_t *client, uint8_t waiting);
+static void ShowFrame(maze_sessions_t *sessions, maze_session_t *session);
+static void FinishGame(maze_sessions_t *sessions, maze_session_t *session);
+static void AddStats(stats_t *to, stats_t *from);
+static uint32_t Percentile(stats_t *stats, uint32_t percent);
+static void PrintStats(const char *label, stats_t *stats, double seconds);
+#ifdef RENDER_ENGINE_THREADS
+static void WorkerDone(void *data);
+#endif
+
+int main(int argc, char **argv) {
+    uint32_t port = 4000;
+    const char *path = 0;
+    uint32_t cacheFrames = 256;
+    uint32_t mazeCells = 0;
+    uint32_t seed = 1;
+    uint32_t seconds = 0;
+    uint32_t numWorkers = 0;
+    int option;
+    
+    maxClients = 1024;
+    while ((option = getopt(argc, argv, "p:u:n:c:m:s:t:w:")) != -1) {
+        switch (option) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'u':
+                path = optarg;
+                break;
+            case 'n':
+                maxClients = atoi(optarg);
+                break;
+            case 'c':
+                cacheFrames = atoi(optarg);
+                break;
+            case 'm':
+                mazeCells = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            case 'w':
+                numWorkers = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-u unix path] "
+                        "[-n max clients] [-c cache frames] "
+                        "[-m random maze cells] [-s seed] [-t seconds] "
+                        "[-w workers]\n", argv[0]);
+                return 1;
+        }
+    }
+    if ((port > UINT16_MAX) || ((port == 0) && (path == 0)) || (maxClients == 0) ||
+            (maxClients > UINT16_MAX) || (cacheFrames > UINT16_MAX) ||
+            ((mazeCells != 0) && ((mazeCells < 2) || (mazeCells > 256))) ||
+            (numWorkers > UINT8_MAX)) {
+        fprintf(stderr, "usage: %s [-p port] [-u unix path] "
+                "[-n max clients] [-c cache frames] "
+                "[-m random maze cells] [-s seed] [-t seconds] [-w workers]\n",
+                argv[0]);
+        return 1;
+    }
+#ifndef RENDER_ENGINE_THREADS
+    if (numWorkers > 0) {
+        fprintf(stderr, "render workers need RENDER_ENGINE_THREADS\n");
+        return 1;
+    }
+#endif
+    
+    // The built in maze also sets up the lattice moves of a random one, whose
+    // grid must stay valid for the pose functions
+    world_t world;
+    maze_grid_t grid;
+    render_instance_t builtIn[MAZE_NUM_INSTANCES];
+    MazeWorld_Build(&world, builtIn);
+    if (mazeCells != 0) {
+        MazeGrid_Init(&grid, malloc(MAZE_GRID_BYTES(mazeCells, mazeCells)),
+                mazeCells, mazeCells, mazeCells / 2, mazeCells / 2);
+        MazeGrid_Generate(&grid, seed);
+        MazeWorld_Load(&world, &grid, malloc(MAZE_GRID_INSTANCES(mazeCells,
+                mazeCells) * sizeof(render_instance_t)));
+    }
+    
+    frame_cache_t cache;
+    frame_cache_entry_t *entries = malloc(cacheFrames * sizeof(frame_cache_entry_t));
+    uint8_t *storage = malloc((size_t) cacheFrames * SCREEN_WIDTH * SCREEN_HEIGHT);
+    render_order_t *order = malloc(RENDER_ORDER_SIZE(&world) * sizeof(render_order_t));
+    maze_session_t *slots = malloc(maxClients * sizeof(maze_session_t));
+    uint32_t i;
+    
+    if (cacheFrames > 0) {
+        FrameCache_Init(&cache, entries, storage, cacheFrames,
+                SCREEN_WIDTH * SCREEN_HEIGHT);
+    }
+    MazeSessions_Init(&sessions, &world, slots, maxClients, order,
+            (cacheFrames > 0) ? &cache : 0, ShowFrame, FinishGame);
+    clients = malloc(maxClients * sizeof(client_t));
+    for (i = 0; i < maxClients; i++) {
+        clients[i].fd = -1;
+        clients[i].session = 0;
+    }
+    
+    signal(SIGINT, Stop);
+    signal(SIGTERM, Stop);
+    signal(SIGPIPE, SIG_IGN);
+    epollFd = epoll_create1(0);
+    if ((port != 0) && (Listen(port, 0) < 0)) {
+        return 1;
+    }
+    if ((path != 0) && (Listen(0, path) < 0)) {
+        return 1;
+    }
+#ifdef RENDER_ENGINE_THREADS
+    // Every session has at most one frame out, so the workers never fill up
+    if (numWorkers > 0) {
+        struct epoll_event event;
+        doneFd = eventfd(0, EFD_NONBLOCK);
+        event.events = EPOLLIN;
+        event.data.u64 = WORKERS_DONE;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, doneFd, &event);
+        if (!Render_Engine_WorkersInit(&workers, numWorkers, maxClients,
+                WorkerDone, 0)) {
+            fprintf(stderr, "could not start %u render workers\n", numWorkers);
+            return 1;
+        }
+    }
+#endif
+    printf("serving %s maze to %u clients,%s%u%s%s, %u cached frames, %u "
+            "render workers\n", (mazeCells != 0) ? "a random" : "the built in",
+            maxClients, (port != 0) ? " 127.0.0.1:" : "", port,
+            (path != 0) ? " " : "", (path != 0) ? path : "", cacheFrames,
+            numWorkers);
+    printf("clients  frames/s      MB/s  renders/s  cached/s  dropped/s  "
+            "keys/s  p50 us  p99 us  wins\n");
+    
+    struct epoll_event events[MAX_EVENTS];
+    uint32_t start = Micros();
+    uint32_t lastStats = start;
+    uint8_t busy = 0;
+    int numEvents, n;
+    
+    while (running) {
+        uint32_t now = Micros();
+        int timeout = 0;
+        
+        // Sleep until the next report when no frame is waiting to be rendered
+        if (!busy) {
+            timeout = (int) (1000 - ((now - lastStats) / 1000));
+            if (timeout < 0) {
+                timeout = 0;
+            }
+        }
+        numEvents = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+        for (n = 0; n < numEvents; n++) {
+            uint32_t data = (uint32_t) events[n].data.u64;
+            if ((data == LISTEN_TCP) || (data == LISTEN_UNIX)) {
+                AcceptClients((int) (events[n].data.u64 >> 32));
+                continue;
+            }
+#ifdef RENDER_ENGINE_THREADS
+            if (data == WORKERS_DONE) {
+                uint64_t count;
+                if (read(doneFd, &count, sizeof(count)) < 0) {
+                    perror("read");
+                }
+                continue;
+            }
+#endif
+            client_t *client = &clients[data];
+            if (client->fd < 0) {
+                continue;
+            }
+            if (events[n].events & (EPOLLERR | EPOLLHUP)) {
+                DropClient(client);
+                continue;
+            }
+            if (events[n].events & EPOLLIN) {
+                ReadKeys(client);
+            }
+            if ((client->fd >= 0) && (events[n].events & EPOLLOUT)) {
+                Flush(client);
+            }
+        }
+        
+        // Render for a slice of time, then go back to the sockets so keys
+        // and writes are not starved by a long queue of frames
+        now = Micros();
+        busy = 1;
+#ifdef RENDER_ENGINE_THREADS
+        if (numWorkers > 0) {
+            // Workers wake the loop when they finish, nothing to poll for
+            MazeSessions_Collect(&sessions, &workers, now);
+            MazeSessions_Dispatch(&sessions, &workers, now);
+            busy = 0;
+        }
+#endif
+        while (busy && ((Micros() - now) < RENDER_SLICE)) {
+            if (MazeSessions_Step(&sessions, UINT32_MAX, Micros())) {
+                busy = 0;
+            }
+        }
+        
+        now = Micros();
+        if ((now - lastStats) >= 1000000) {
+            interval.renders = sessions.renders;
+            interval.cacheFrames = sessions.cacheFrames;
+            sessions.renders = 0;
+            sessions.cacheFrames = 0;
+            PrintStats("", &interval, (now - lastStats) / 1e6);
+            AddStats(&total, &interval);
+            memset(&interval, 0, sizeof(interval));
+            lastStats = now;
+        }
+        if ((seconds != 0) && ((now - start) >= seconds * 1000000)) {
+            running = 0;
+        }
+    }
+    
+    interval.renders = sessions.renders;
+    interval.cacheFrames = sessions.cacheFrames;
+    AddStats(&total, &interval);
+    printf("%llu connections\n", (unsigned long long) total.accepted);
+    PrintStats("total\n", &total, (Micros() - start) / 1e6);
+#ifdef RENDER_ENGINE_THREADS
+    for (i = 0; i < numWorkers; i++) {
+        printf("worker %u: %u frames, %u stolen\n", i,
+                workers.workers[i].rendered, workers.workers[i].stolen);
+    }
+    if (numWorkers > 0) {
+        Render_Engine_WorkersDestroy(&workers);
+    }
+#endif
+    if (path != 0) {
+        unlink(path);
+    }
+    return 0;
+}
+
+void Stop(int signal) {
+    (void) signal;
+    running = 0;
+}
+
+uint32_t Micros(void) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((now.tv_sec * 1000000ull) + (now.tv_nsec / 1000));
+}
+
+int Listen(uint16_t port, const char *path) {
+    struct sockaddr_in inet;
+    struct sockaddr_un local;
+    struct epoll_event event;
+    int listener, one = 1;
+    
+    if (path == 0) {
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        memset(&inet, 0, sizeof(inet));
+        inet.sin_family = AF_INET;
+        inet.sin_port = htons(port);
+        inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener, (struct sockaddr *) &inet, sizeof(inet)) < 0) {
+            perror("bind");
+            return -1;
+        }
+    } else {
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        strncpy(local.sun_path, path, sizeof(local.sun_path) - 1);
+        unlink(path);
+        if (bind(listener, (struct sockaddr *) &local, sizeof(local)) < 0) {
+            perror("bind");
+            return -1;
+        }
+    }
+    if (listen(listener, 1024) < 0) {
+        perror("listen");
+        return -1;
+    }
+    
+    // The listener's fd rides in the high half next to its marker
+    event.events = EPOLLIN;
+    event.data.u64 = ((uint64_t) listener << 32) | ((path == 0) ? LISTEN_TCP : LISTEN_UNIX);
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listener, &event);
+    return listener;
+}
+
+void AcceptClients(int listener) {
+    static const char hello[] = "\x1b[?25l\x1b[2J"; // hide the cursor, clear
+    struct epoll_event event;
+    uint32_t slot;
+    int fd, one = 1;
+    
+    while ((fd = accept(listener, 0, 0)) >= 0) {
+        if (numClients == maxClients) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        // A closed client's frame may still be with a render worker
+        for (slot = 0; slot < maxClients; slot++) {
+            if ((clients[slot].fd < 0) && ((clients[slot].session == 0) ||
+                    !clients[slot].session->queued)) {
+                break;
+            }
+        }
+        if (slot == maxClients) {
+            close(fd);
+            continue;
+        }
+        client_t *client = &clients[slot];
+        client->session = MazeSessions_Open(&sessions, client->frame,
+                SCREEN_WIDTH, SCREEN_HEIGHT, client, Micros());
+        if (client->session == 0) {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->sending = client->buffers[0];
+        client->pending = client->buffers[1];
+        client->sendLength = 0;
+        client->sent = 0;
+        client->pendingLength = 0;
+        client->waiting = 0;
+        numClients++;
+        interval.accepted++;
+        
+        // Frames are written whole, don't hold back their last segment
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (write(fd, hello, sizeof(hello) - 1) > 0) {
+            interval.bytes += sizeof(hello) - 1;
+        }
+        event.events = EPOLLIN;
+        event.data.u64 = slot;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void ReadKeys(client_t *client) {
+    maze_session_t *session = client->session;
+    uint8_t keys[MAZE_SESSION_KEYS];
+    uint32_t now = Micros();
+    ssize_t count, i;
+    uint8_t room;
+    
+    // Only take the keys the session has room for, the rest wait in the
+    // socket until the render loop has applied these
+    room = (session->keyTail + MAZE_SESSION_KEYS - session->keyHead - 1) %
+            MAZE_SESSION_KEYS;
+    if (room == 0) {
+        return;
+    }
+    while ((count = read(client->fd, keys, room)) > 0) {
+        for (i = 0; i < count; i++) {
+            // 'q' and Ctrl-C leave, everything else is up to the session
+            if ((keys[i] == 'q') || (keys[i] == 3)) {
+                DropClient(client);
+                return;
+            }
+            MazeSession_Key(session, keys[i], now);
+        }
+        interval.keys += count;
+        room -= count;
+        if (room == 0) {
+            return;
+        }
+    }
+    if ((count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+        DropClient(client);
+    }
+}
+
+void DropClient(client_t *client) {
+    MazeSessions_Close(&sessions, client->session);
+    close(client->fd);
+    client->fd = -1;
+    numClients--;
+}
+
+void Flush(client_t *client) {
+    struct iovec parts[2];
+    uint32_t first = client->sendLength - client->sent;
+    int numParts = 0;
+    ssize_t written;
+    
+    if (first > 0) {
+        parts[numParts].iov_base = client->sending + client->sent;
+        parts[numParts++].iov_len = first;
+    }
+    if (client->pendingLength > 0) {
+        parts[numParts].iov_base = client->pending;
+        parts[numParts++].iov_len = client->pendingLength;
+    }
+    if (numParts == 0) {
+        Watch(client, 0);
+        return;
+    }
+    
+    written = writev(client->fd, parts, numParts);
+    if (written < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            Watch(client, 1);
+        } else {
+            DropClient(client);
+        }
+        return;
+    }
+    interval.bytes += written;
+    
+    // Whatever of the pending frame went out makes it the one being sent
+    if ((uint32_t) written < first) {
+        client->sent += written;
+    } else {
+        if (first > 0) {
+            interval.frames++;
+        }
+        if (client->pendingLength > 0) {
+            uint8_t *done = client->sending;
+            client->sending = client->pending;
+            client->sendLength = client->pendingLength;
+            client->sent = written - first;
+            client->pending = done;
+            client->pendingLength = 0;
+            if (client->sent == client->sendLength) {
+                interval.frames++;
+            }
+        } else {
+            client->sent = client->sendLength;
+        }
+    }
+    Watch(client, client->sent < client->sendLength);
+}
+
+void Watch(client_t *client, uint8_t waiting) {
+    struct epoll_event event;
+    
+    if (client->waiting == waiting) {
+        return;
+    }
+    event.events = EPOLLIN | (waiting ? EPOLLOUT : 0);
+    event.data.u64 = client - clients;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, client->fd, &event);
+    client->waiting = waiting;
+}
+
+void ShowFrame(maze_sessions_t *sessions, maze_session_t *session) {
+    client_t *client = session->user;
+    uint32_t bucket;
+    
+    (void) sessions;
+    if (session->latency != UINT32_MAX) {
+        bucket = session->latency / 10;
+        interval.latency[(bucket < LATENCY_BUCKETS) ? bucket : LATENCY_BUCKETS - 1]++;
+    }
+    
+    // A frame that has not started going out is stale now, replace it
+    if (client->pendingLength > 0) {
+        interval.dropped++;
+    }
+    client->pendingLength = Render_Engine_EncodeFrame(&session->frame, client->pending);
+    if (!client->waiting) {
+        Flush(client);
+    }
+}
+
+void FinishGame(maze_sessions_t *sessions, maze_session_t *session) {
+    client_t *client = session->user;
+    
+    // Back to the start for another go
+    (void) sessions;
+    interval.wins++;
+    MazeSession_Start(session, client->frame, SCREEN_WIDTH, SCREEN_HEIGHT, Micros());
+}
+
+void AddStats(stats_t *to, stats_t *from) {
+    uint32_t i;
+    
+    to->frames += from->frames;
+    to->bytes += from->bytes;
+    to->dropped += from->dropped;
+    to->keys += from->keys;
+    to->wins += from->wins;
+    to->accepted += from->accepted;
+    to->renders += from->renders;
+    to->cacheFrames += from->cacheFrames;
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        to->latency[i] += from->latency[i];
+    }
+}
+
+uint32_t Percentile(stats_t *stats, uint32_t percent) {
+    uint64_t count = 0, seen = 0;
+    uint32_t i;
+    
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        count += stats->latency[i];
+    }
+    if (count == 0) {
+        return 0;
+    }
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += stats->latency[i];
+        if (seen * 100 >= count * percent) {
+            break;
+        }
+    }
+    return (i + 1) * 10;
+}
+
+void PrintStats(const char *label, stats_t *stats, double seconds) {
+    printf("%s%7u  %8.0f  %8.2f  %9.0f  %8.0f  %9.0f  %6.0f  %6u  %6u  %4llu\n",
+            label, numClients, stats->frames / seconds,
+            stats->bytes / seconds / 1e6, stats->renders / seconds,
+            stats->cacheFrames / seconds, stats->dropped / seconds,
+            stats->keys / seconds, Percentile(stats, 50), Percentile(stats, 99),
+            (unsigned long long) stats->wins);
+    fflush(stdout);
+}
+
+#ifdef RENDER_ENGINE_THREADS
+void WorkerDone(void *data) {
+    uint64_t one = 1;
+    
+    (void) data;
+    if (write(doneFd, &one, sizeof(one)) < 0) {
+        perror("write");
+    }
+}
+#endif
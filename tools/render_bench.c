@@ -0,0 +1,299 @@
+/*
+ * render_bench.c
+ *
+ * Host tool that times Render_Engine_RenderFrame() with and without a vertex
+ * store (Render_Engine_LoadVertices()), into a column layout framebuffer, with
+ * a retained scene (Render_Engine_LoadScene()) and
+ * Render_Engine_RenderFrameParallel() on the maze world, and whole frames
+ * rendered side by side by render workers (Render_Engine_SubmitJob()) as a
+ * server for many players would. Every frame is compared with the plain single
+ * threaded frame of the same pose, neither the batched projection, the column
+ * layout, the scene culling, the tile binning nor the workers may change a
+ * single pixel. Add -DRENDER_ENGINE_NO_SIMD to check the scalar
+ * batches, or -mavx to use AVX.
+ *
+ * Build from the repository root with:
+ *   gcc -O2 -DRENDER_ENGINE_HOST -DRENDER_ENGINE_THREADS -I.
+ *       tools/render_bench.c render_engine.c maze_world.c -lm -lpthread
+ *       -o render_bench
+ * and once more with -march=native. On a host with FMA the compiler may then
+ * fuse multiply-adds, which the engine must not let change a pixel either.
+ *
+ * Usage:
+ *   render_bench [-w width] [-h height] [-f frames] [-t max threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include "render_engine.h"
+#include "maze_world.h"
+
+static double Seconds(struct timespec *start, struct timespec *end);
+static void Finished(void *semaphore);
+
+int main(int argc, char **argv) {
+    uint32_t width = 320;
+    uint32_t height = 96;
+    uint32_t numFrames = 200;
+    uint32_t maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int option;
+    
+    while ((option = getopt(argc, argv, "w:h:f:t:")) != -1) {
+        switch (option) {
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'h':
+                height = atoi(optarg);
+                break;
+            case 'f':
+                numFrames = atoi(optarg);
+                break;
+            case 't':
+                maxThreads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-w width] [-h height] [-f frames] "
+                        "[-t max threads]\n", argv[0]);
+                return 1;
+        }
+    }
+    if ((width == 0) || (height == 0) || (width > UINT16_MAX) ||
+            (height > UINT16_MAX) || (numFrames == 0) || (numFrames > UINT16_MAX) ||
+            (maxThreads > UINT8_MAX)) {
+        fprintf(stderr, "usage: %s [-w width] [-h height] [-f frames] "
+                "[-t max threads]\n", argv[0]);
+        return 1;
+    }
+    
+    world_t world;
+    render_instance_t instances[MAZE_NUM_INSTANCES];
+    MazeWorld_Build(&world, instances);
+    
+    // Walk the camera around the maze so the frames are not all the same
+    maze_pose_t *poses = malloc(numFrames * sizeof(maze_pose_t));
+    maze_pose_t pose;
+    uint32_t i;
+    MazeWorld_StartPose(&pose);
+    for (i = 0; i < numFrames; i++) {
+        MazeWorld_ApplyMove(&pose, ((i / 8) % 3 == 2) ? MazeTurnLeft : MazeForward);
+        poses[i] = pose;
+    }
+    
+    uint8_t *expected = malloc((size_t) numFrames * width * height);
+    uint8_t *buffer = malloc((size_t) width * height);
+    framebuffer_t frame = {width, height, 0, RenderLayoutRows};
+    camera_t camera;
+    struct timespec start, end;
+    double single;
+    
+    // Single threaded reference
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numFrames; i++) {
+        frame.buffer = expected + ((size_t) i * width * height);
+        MazeWorld_SetCamera(&poses[i], &camera);
+        Render_Engine_RenderFrame(&world, &camera, &frame);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    single = Seconds(&start, &end);
+#ifdef __FMA__
+    printf("%ux%u, %u frames, FMA target\n", width, height, numFrames);
+#else
+    printf("%ux%u, %u frames\n", width, height, numFrames);
+#endif
+    printf("RenderFrame:                    %8.3f ms per frame\n",
+            single * 1000 / numFrames);
+    
+    // Same frames with the corners projected in batches
+    render_vertices_t vertices;
+    rounding_t *storage = malloc(3 * RENDER_VERTEX_STRIDE(world.numTriangles) *
+            sizeof(rounding_t));
+    uint32_t mismatches = 0;
+    double batched;
+    Render_Engine_LoadVertices(&world, &vertices, storage);
+    frame.buffer = buffer;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numFrames; i++) {
+        MazeWorld_SetCamera(&poses[i], &camera);
+        Render_Engine_RenderFrame(&world, &camera, &frame);
+        if (memcmp(buffer, expected + ((size_t) i * width * height),
+                (size_t) width * height) != 0) {
+            mismatches++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    batched = Seconds(&start, &end);
+    printf("RenderFrame vertex store:       %8.3f ms per frame, %.2fx, %u frames "
+            "differ\n", batched * 1000 / numFrames, single / batched, mismatches);
+    if (mismatches > 0) {
+        return 1;
+    }
+    
+    // Same frames painted into columns, then copied into rows to compare
+    uint8_t *columns = malloc((size_t) width * height);
+    framebuffer_t columnFrame = {width, height, columns, RenderLayoutColumns};
+    struct timespec copied;
+    double painted = 0, transposed = 0;
+    for (i = 0; i < numFrames; i++) {
+        MazeWorld_SetCamera(&poses[i], &camera);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        Render_Engine_RenderFrame(&world, &camera, &columnFrame);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        Render_Engine_TransposeFrame(&columnFrame, buffer);
+        clock_gettime(CLOCK_MONOTONIC, &copied);
+        painted += Seconds(&start, &end);
+        transposed += Seconds(&end, &copied);
+        if (memcmp(buffer, expected + ((size_t) i * width * height),
+                (size_t) width * height) != 0) {
+            mismatches++;
+        }
+    }
+    printf("RenderFrame column layout:      %8.3f ms per frame, %.2fx, %u frames "
+            "differ\n", painted * 1000 / numFrames, batched / painted, mismatches);
+    printf("  + TransposeFrame:             %8.3f ms per frame, %.2fx\n",
+            (painted + transposed) * 1000 / numFrames,
+            batched / (painted + transposed));
+    free(columns);
+    if (mismatches > 0) {
+        return 1;
+    }
+    
+    // Same frames from a scene, building it is timed on its own as it is only
+    // done once per world. The parallel runs below use the scene too
+    render_scene_t scene;
+    void *sceneStorage = malloc(RENDER_SCENE_STORAGE(world.numTriangles));
+    double built, culled;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Render_Engine_LoadScene(&world, &scene, sceneStorage);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    built = Seconds(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numFrames; i++) {
+        MazeWorld_SetCamera(&poses[i], &camera);
+        Render_Engine_RenderFrame(&world, &camera, &frame);
+        if (memcmp(buffer, expected + ((size_t) i * width * height),
+                (size_t) width * height) != 0) {
+            mismatches++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    culled = Seconds(&start, &end);
+    printf("LoadScene:                      %8.3f ms once, %u of %u corners "
+            "distinct\n", built * 1000, scene.vertices.count,
+            world.numTriangles * 3);
+    printf("RenderFrame scene:              %8.3f ms per frame, %.2fx, %u frames "
+            "differ\n", culled * 1000 / numFrames, batched / culled, mismatches);
+    if (mismatches > 0) {
+        return 1;
+    }
+    
+    // The calling thread paints tiles too, so 0 workers is one thread
+    uint32_t threads;
+    for (threads = 1; threads <= maxThreads; threads++) {
+        render_pool_t pool;
+        double parallel;
+        
+        mismatches = 0;
+        if (!Render_Engine_PoolInit(&pool, threads - 1)) {
+            fprintf(stderr, "could not start %u threads\n", threads);
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < numFrames; i++) {
+            MazeWorld_SetCamera(&poses[i], &camera);
+            Render_Engine_RenderFrameParallel(&world, &camera, &frame, &pool);
+            if (memcmp(buffer, expected + ((size_t) i * width * height),
+                    (size_t) width * height) != 0) {
+                mismatches++;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        Render_Engine_PoolDestroy(&pool);
+        
+        parallel = Seconds(&start, &end);
+        printf("RenderFrameParallel %2u threads: %8.3f ms per frame, %.2fx, %u "
+                "frames differ\n", threads, parallel * 1000 / numFrames,
+                single / parallel, mismatches);
+        if (mismatches > 0) {
+            return 1;
+        }
+    }
+    
+    // Every frame is a job of its own, all queued at once like the frames of
+    // many players who pressed a key together
+    render_job_t *jobs = malloc(numFrames * sizeof(render_job_t));
+    render_job_t *done[64];
+    uint8_t *rendered = malloc((size_t) numFrames * width * height);
+    sem_t finished;
+    sem_init(&finished, 0, 0);
+    for (threads = 1; threads <= maxThreads; threads++) {
+        render_workers_t workers;
+        uint32_t collected = 0, stolen = 0;
+        double side;
+        uint16_t count, k;
+        
+        mismatches = 0;
+        if (!Render_Engine_WorkersInit(&workers, threads, numFrames, Finished,
+                &finished)) {
+            fprintf(stderr, "could not start %u workers\n", threads);
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < numFrames; i++) {
+            jobs[i].world = &world;
+            MazeWorld_SetCamera(&poses[i], &jobs[i].camera);
+            jobs[i].frame = frame;
+            jobs[i].frame.buffer = rendered + ((size_t) i * width * height);
+            jobs[i].user = 0;
+            Render_Engine_SubmitJob(&workers, &jobs[i]);
+        }
+        while (collected < numFrames) {
+            // Sleep instead of spinning, the workers may need this core
+            sem_wait(&finished);
+            count = Render_Engine_CollectJobs(&workers, done, 64);
+            for (k = 0; k < count; k++) {
+                i = done[k] - jobs;
+                if (memcmp(done[k]->frame.buffer, expected + ((size_t) i * width *
+                        height), (size_t) width * height) != 0) {
+                    mismatches++;
+                }
+            }
+            collected += count;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        for (i = 0; i < threads; i++) {
+            stolen += workers.workers[i].stolen;
+        }
+        Render_Engine_WorkersDestroy(&workers);
+        
+        side = Seconds(&start, &end);
+        printf("Render workers %2u threads:      %8.3f ms per frame, %.2fx, %u "
+                "frames differ, %u stolen\n", threads, side * 1000 / numFrames,
+                single / side, mismatches, stolen);
+        if (mismatches > 0) {
+            return 1;
+        }
+    }
+    
+    free(jobs);
+    free(rendered);
+    sem_destroy(&finished);
+    free(sceneStorage);
+    free(storage);
+    free(poses);
+    free(expected);
+    free(buffer);
+    return 0;
+}
+
+double Seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + ((end->tv_nsec - start->tv_nsec) / 1e9);
+}
+
+void Finished(void *semaphore) {
+    sem_post(semaphore);
+}